@@ -1,14 +1,20 @@
 #pragma once
 
 #include <james/expat-parser.hpp>
+#include <james/expat-path-trie.hpp>
+#include <james/string-view.hpp>
+#include <cstring>
 #include <functional>
-#include <map>
+#include <string>
+#include <vector>
 
 namespace james {
 
+  // Where a listener is being called from. name and path are only valid for the
+  // duration of the callback; copy them if they are needed later.
   struct Path {
-    std::string name;
-    std::string path;
+    StringView name;
+    StringView path;
     int depth;
     int instance;
 
@@ -23,6 +29,29 @@ namespace james {
     Attribute(const char* name, const char* value) : name(name), value(value) {}
   };
 
+  // An attribute name prepared for repeated lookups, e.g. a listener member created
+  // when the listener is registered.
+  //
+  // The parser hands out one name pointer per distinct attribute name and keeps it for
+  // the whole document (expat interns names in its DTD tables). The first successful
+  // lookup therefore records that pointer, and from then on lookups made while parsing
+  // the same document compare pointers instead of strings.
+  //
+  // The recorded pointer is not synchronised; a key must not be shared by documents
+  // parsed concurrently.
+  struct AttributeKey {
+    explicit AttributeKey(const char* name) : name_(name), interned_(nullptr), document_(0) {}
+
+    const char* Name() const { return name_; }
+
+  private:
+    friend struct Attributes;
+
+    const char* name_;
+    mutable const char* interned_;
+    mutable unsigned int document_;
+  };
+
   struct Attributes {
 
     struct Iterator {
@@ -42,6 +71,19 @@ namespace james {
 
     explicit Attributes(const char** data);
 
+    // document identifies the document being parsed (never 0) and enables the
+    // AttributeKey pointer cache; Attributes built without one always compare strings.
+    Attributes(const char** data, unsigned int document);
+
+    const char* operator[] (const AttributeKey& key) const {
+      const char** att = Find(key);
+      return att ? att[1] : "";
+    }
+
+    bool Has(const AttributeKey& key) const {
+      return Find(key) != nullptr;
+    }
+
     const char* operator[] (const char* name) const {
       for (std::size_t i = 0; data_[i]; i += 2) {
         if (strcmp(data_[i], name) == 0) {
@@ -73,6 +115,29 @@ namespace james {
 
   private:
     const char** data_;
+    unsigned int document_;
+
+    const char** Find(const AttributeKey& key) const {
+      if (document_ != 0 && key.document_ == document_) {
+        for (std::size_t i = 0; data_[i]; i += 2) {
+          if (data_[i] == key.interned_) {
+            return data_ + i;
+          }
+        }
+        return nullptr;
+      }
+
+      for (std::size_t i = 0; data_[i]; i += 2) {
+        if (strcmp(data_[i], key.name_) == 0) {
+          if (document_ != 0) {
+            key.interned_ = data_[i];
+            key.document_ = document_;
+          }
+          return data_ + i;
+        }
+      }
+      return nullptr;
+    }
   };
 
   struct ExpatFacade;
@@ -81,44 +146,200 @@ namespace james {
     typedef std::function<void(const Path&, const Attributes&)> TagOpenedFunc;
     typedef std::function<void(const Path&)> TagClosedFunc;
     typedef std::function<void(const Path&, const std::string&)> TextContentFunc;
+    typedef std::function<void(const Path&, StringView)> TextChunkFunc;
 
     TagOpenedFunc TagOpened;
     TagClosedFunc TagClosed;
     TextContentFunc TextContent;
 
+    // Called with each piece of text as the parser produces it, without the text being
+    // collected first. The view points into the parser's buffer and is only valid for
+    // the duration of the call; a number or word may be split across two calls.
+    TextChunkFunc TextChunk;
+
     Tag& Opened(TagOpenedFunc f) { TagOpened = f; return *this; }
     Tag& Closed(TagClosedFunc f) { TagClosed = f; return *this; }
     Tag& Text(TextContentFunc f) { TextContent = f; return *this; }
+    Tag& Chunk(TextChunkFunc f) { TextChunk = f; return *this; }
   };
 
-  struct ExpatFacade
+  // A number identifying the document a facade has just started parsing to the
+  // AttributeKey caches (see Attributes). Never 0.
+  unsigned int NextDocument();
+
+  // The element tracking behind ExpatFacade and StaticFacade. Follows the parser through
+  // the registered paths and passes each event for a registered element to Derived, which
+  // must provide (the calls are resolved at compile time):
+  //
+  //   void Opened(PathTrie::NodeIndex, const Path&, const Attributes&);
+  //   void Closed(PathTrie::NodeIndex, const Path&);
+  //   void Text(PathTrie::NodeIndex, const Path&, const std::string&);
+  //   void Chunk(PathTrie::NodeIndex, const Path&, StringView);
+  //
+  // Text is only called for nodes added with wantsText, and Chunk for nodes added with
+  // wantsChunks.
+  template <typename Derived>
+  struct BasicFacade
     : private ExpatParser::XMLConsumer
   {
+    ExpatParser::XMLConsumer& XMLConsumer() { return *this; }
 
-    ExpatFacade();
+  protected:
+    BasicFacade()
+      : nodes_(1), unmatchedDepth_(0), document_(0)
+    {
+      openNodes_.reserve(32);
+      openNodes_.push_back(PathTrie::ROOT);
+    }
 
-    ExpatParser::XMLConsumer& XMLConsumer() { return *this; }
+    BasicFacade(const BasicFacade&) = delete;
+    BasicFacade& operator =(const BasicFacade&) = delete;
 
-    void ListenFor(const std::string&, const Tag&);
+    // Adds path (and any missing prefixes) to the tracked paths; returns its node
+    PathTrie::NodeIndex AddPath(const std::string& path, bool wantsText, bool wantsChunks) {
+      PathTrie::NodeIndex node = paths_.Insert(path);
+      nodes_.resize(paths_.Size());
+
+      nodes_[node].wantsText = nodes_[node].wantsText || wantsText;
+      nodes_[node].wantsChunks = nodes_[node].wantsChunks || wantsChunks;
+      return node;
+    }
+
+    std::size_t NodeCount() const { return paths_.Size(); }
 
   private:
-    struct TagData {
-      Tag tag;
+    struct NodeData {
       std::string textContent;
+      bool wantsText;
+      bool wantsChunks;
       int instanceCount;
 
-      TagData(const Tag& tag) : tag(tag), instanceCount(0) {}
+      NodeData() : wantsText(false), wantsChunks(false), instanceCount(0) {}
     };
 
-    typedef std::multimap<std::string, TagData> TagMap;
+    PathTrie paths_;
+    std::vector<NodeData> nodes_;
 
-    TagMap tags_;
-    std::pair<TagMap::iterator, TagMap::iterator> matchedTags_;
+    // Trie nodes of the currently open elements that have a listener at or below
+    // them. Elements outside the trie only bump unmatchedDepth_.
+    std::vector<PathTrie::NodeIndex> openNodes_;
+    int unmatchedDepth_;
     Path currentPath_;
 
-    void StartElement(const char *name, const char **atts) override;
-    void EndElement(const char *name) override;
-    void CharacterData(const XML_Char *s, int len) override;
+    // Identifies the document being parsed to AttributeKey caches
+    unsigned int document_;
+
+    Derived& Self() { return *static_cast<Derived*>(this); }
+
+    void FlushText(PathTrie::NodeIndex node) {
+      NodeData& data = nodes_[node];
+
+      if (data.textContent.length() > 0) {
+        Self().Text(node, currentPath_, data.textContent);
+        data.textContent.clear();
+      }
+    }
+
+    void SetCurrentNode(PathTrie::NodeIndex node) {
+      currentPath_.name = paths_.Name(node);
+      currentPath_.path = paths_.Path(node);
+      currentPath_.instance = (node == PathTrie::ROOT) ? 0 : nodes_[node].instanceCount - 1;
+    }
+
+    void StartElement(const char *name, const char **atts) override {
+      // The root element starts a new document, possibly with a new parser whose
+      // interned names differ from the last one's
+      if (currentPath_.depth == 0) {
+        document_ = NextDocument();
+      }
+
+      currentPath_.depth++;
+
+      if (unmatchedDepth_ > 0) {
+        unmatchedDepth_++;
+        return;
+      }
+
+      // Text seen so far belongs to the parent and is delivered before the child opens
+      PathTrie::NodeIndex parent = openNodes_.back();
+      FlushText(parent);
+
+      // Nothing below an element outside the trie can match, so the parser is asked to
+      // pass over its contents; unmatchedDepth_ still counts for parsers that don't
+      PathTrie::NodeIndex node = paths_.Child(parent, name);
+      if (node == PathTrie::NO_NODE) {
+        unmatchedDepth_ = 1;
+        SkipElement();
+        return;
+      }
+
+      openNodes_.push_back(node);
+      nodes_[node].instanceCount++;
+      SetCurrentNode(node);
+
+      Self().Opened(node, currentPath_, Attributes(atts, document_));
+
+      // Likewise for a leaf whose text nobody wants
+      const NodeData& data = nodes_[node];
+      if (!paths_.HasChildren(node) && !data.wantsText && !data.wantsChunks) {
+        SkipElement();
+      }
+    }
+
+    void EndElement(const char *name) override {
+      if (unmatchedDepth_ > 0) {
+        unmatchedDepth_--;
+        currentPath_.depth--;
+        return;
+      }
+
+      PathTrie::NodeIndex node = openNodes_.back();
+      FlushText(node);
+
+      Self().Closed(node, currentPath_);
+
+      openNodes_.pop_back();
+      currentPath_.depth--;
+
+      PathTrie::NodeIndex parent = openNodes_.back();
+      SetCurrentNode(parent);
+    }
+
+    void CharacterData(const XML_Char *s, int len) override {
+      if (unmatchedDepth_ > 0) {
+        return;
+      }
+
+      PathTrie::NodeIndex node = openNodes_.back();
+      NodeData& data = nodes_[node];
+      if (data.wantsChunks) {
+        Self().Chunk(node, currentPath_, StringView(s, (std::size_t)len));
+      }
+      if (data.wantsText) {
+        data.textContent.append(s, len);
+      }
+    }
+  };
+
+  // Calls the Tags registered with ListenFor. Each event goes through the Tag's
+  // std::function; see StaticFacade for listeners known at compile time.
+  struct ExpatFacade
+    : BasicFacade<ExpatFacade>
+  {
+    ExpatFacade();
+
+    void ListenFor(const std::string&, const Tag&);
+
+  private:
+    friend struct BasicFacade<ExpatFacade>;
+
+    // Listeners for each node of the path trie
+    std::vector<std::vector<Tag>> tags_;
+
+    void Opened(PathTrie::NodeIndex node, const Path&, const Attributes&);
+    void Closed(PathTrie::NodeIndex node, const Path&);
+    void Text(PathTrie::NodeIndex node, const Path&, const std::string&);
+    void Chunk(PathTrie::NodeIndex node, const Path&, StringView);
   };
 
-} // james
\ No newline at end of file
+} // james
@@ -1,20 +1,23 @@
 #pragma once
 
 #include <james/expat-parser.hpp>
+#include <james/expat-path-trie.hpp>
+#include <james/string-view.hpp>
+#include <string>
 #include <vector>
-#include <utility>
 
 namespace james {
 
   struct ExpatParserDispatcher
     : ExpatParser::XMLConsumer
   {
+    // name and path are only valid for the duration of the callback
     struct NodeID {
-      const char* name;
-      std::string path;
+      StringView name;
+      StringView path;
       int depth;
 
-      NodeID() : name(nullptr), depth(0) {}
+      NodeID() : depth(0) {}
     };
 
     struct XMLConsumer {
@@ -26,8 +29,9 @@ namespace james {
       virtual void CharacterData(const NodeID& id, const XML_Char *s, int len) {}
     };
 
-    ExpatParserDispatcher() : defaultConsumer_(nullptr) {}
+    ExpatParserDispatcher();
 
+    // tagName is an absolute path, e.g. "/COLLADA/asset"
     void AddConsumer(const std::string& tagName, XMLConsumer* consumer);
     void SetDefaultConsumer(XMLConsumer* consumer);
 
@@ -36,9 +40,21 @@ namespace james {
     void CharacterData(const XML_Char *s, int len) override;
 
   private:
+    typedef std::vector<XMLConsumer*> ConsumerList;
+
     XMLConsumer* defaultConsumer_;
-    std::vector<std::pair<std::string, XMLConsumer*>> consumers_;
+    PathTrie paths_;
+    std::vector<ConsumerList> consumers_;
     NodeID currentNode_;
+
+    // Trie nodes of the open elements that lie on a registered path; deeper elements
+    // only bump unmatchedDepth_. Their paths are built in unmatchedPath_, and only
+    // when there is a default consumer to see them.
+    std::vector<PathTrie::NodeIndex> openNodes_;
+    int unmatchedDepth_;
+    std::string unmatchedPath_;
+
+    const ConsumerList* CurrentConsumers() const;
   };
 
 } // james
\ No newline at end of file
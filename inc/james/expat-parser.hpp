@@ -2,6 +2,8 @@
 
 #include <expat.h>
 #include <stdexcept>
+#include <exception>
+#include <string>
 #include <istream>
 
 namespace james {
@@ -15,25 +17,41 @@ namespace james {
     DEFAULT_HANDLERS_ONLY = 0
   };
 
+  struct SimdXmlParser;
+
+  // A document that couldn't be parsed. Both ExpatParser and SimdXmlParser throw
+  // subclasses of it, so callers that don't mind which parser was used can catch this.
+  struct ParseError
+    : std::runtime_error
+  {
+    ParseError(const char* what, const char* msg, size_t line)
+      : std::runtime_error(what), msg_(msg), line_(line)
+    {}
+
+    const char* Message() const { return msg_; }
+    size_t Line() const { return line_; }
+
+  private:
+    const char* msg_;
+    size_t line_;
+  };
+
   struct ExpatParser {
     struct Exception
-      : std::runtime_error
+      : ParseError
     {
       Exception(const XML_LChar* msg, XML_Error code, XML_Size line)
-        : std::runtime_error("ExpatParser::Exception"), msg_(msg), code_(code), line_(line)
+        : ParseError("ExpatParser::Exception", msg, (size_t)line), code_(code)
       {}
 
-      const XML_LChar* Message() const { return msg_; }
       XML_Error Code() const { return code_; }
-      XML_Size Line() const { return line_; }
 
     private:
-      const XML_LChar* msg_;
       XML_Error code_;
-      XML_Size line_;
     };
 
     struct XMLConsumer {
+      XMLConsumer() : skipRequested_(false) {}
       virtual ~XMLConsumer() {}
 
       virtual void StartElement(const char *name, const char **atts) {}
@@ -46,6 +64,27 @@ namespace james {
       virtual void Comment(const XML_Char *data) {}
       virtual void StartCData() {}
       virtual void EndCData() {}
+
+    protected:
+      // May be called from StartElement to say nothing inside the element is wanted. The
+      // parser then reports no more events until the element's EndElement, and spends as
+      // little time as it can getting there.
+      void SkipElement() { skipRequested_ = true; }
+
+    private:
+      friend struct ExpatParser;
+      friend struct SimdXmlParser;
+
+      bool skipRequested_;
+    };
+
+    // Elements passed over at a consumer's request (see XMLConsumer::SkipElement), and
+    // the number of bytes from their start tags up to their end tags
+    struct SkipStats {
+      size_t elements;
+      unsigned long long bytes;
+
+      SkipStats() : elements(0), bytes(0) {}
     };
 
     ExpatParser(XMLConsumer&, RegisteredHandlers handlers = DEFAULT_HANDLERS_ONLY);
@@ -57,12 +96,37 @@ namespace james {
     void Parse(const char* data, size_t length, bool done);
     void Parse(const std::string&, bool done = true);
 
+    // In-place parsing: GetBuffer returns expat-owned memory that at least length bytes
+    // may be written into, and ParseBuffer parses the first length bytes of it. This
+    // saves the copy Parse makes of the caller's data.
+    char* GetBuffer(size_t length);
+    void ParseBuffer(size_t length, bool done);
+
+    // Number of bytes expat is holding back because they belong to an incomplete token.
+    size_t PendingBytes() const;
+
+    const SkipStats& Skipped() const { return skipped_; }
+
   private:
     XMLConsumer& consumer_;
     XML_Parser parser_;
+    RegisteredHandlers handlers_;
     bool done_;
     std::exception_ptr currentException_;
 
+    // While an element is being skipped expat reports to the Skip* handlers, which only
+    // count nesting depth until the element's end tag
+    int skipDepth_;
+    XML_Index skipStart_;
+    SkipStats skipped_;
+
+    void ThrowParseError();
+    void SetHandlers(bool skipping);
+    void BeginSkip();
+
+    static void XMLCALL SkipStartElement(void *userData, const char *name, const char **atts);
+    static void XMLCALL SkipEndElement(void *userData, const char *name);
+
     static void XMLCALL StartElement(void *userData, const char *name, const char **atts);
     static void XMLCALL EndElement(void *userData, const char *name);
     static void XMLCALL CharacterDataHandler(void *userData, const XML_Char *s, int len);
@@ -82,5 +146,13 @@ namespace james {
 
   const char* FindAttribute(const char** atts, const char* name, const char* defaultVal = nullptr);
 
+  // Both ParseStream variants throw ExpatParser::Exception if the stream fails other than
+  // by reaching its end, as one for a file that couldn't be opened does
   void ParseStream(ExpatParser& parser, std::istream&, size_t bufferSize = 1024);
+
+  // Reads directly into expat's buffer (see ExpatParser::GetBuffer). Whenever a read leaves
+  // a large incomplete token behind - e.g. a multi-megabyte text node - the read size is
+  // doubled, so the token is rescanned a logarithmic rather than linear number of times.
+  void ParseStreamInPlace(ExpatParser& parser, std::istream&,
+    size_t initialReadSize = 64 * 1024, size_t maxReadSize = 64 * 1024 * 1024);
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace james {
+
+  // A set of absolute element paths ("/COLLADA/library_geometries/geometry") compiled
+  // into a tree with one node per path prefix. A parser tracks its position as a node
+  // index, so moving to a child element costs one name match against that node's
+  // children rather than building and looking up the full path string.
+  //
+  // Element names are interned: each distinct name is stored once and nodes refer to it.
+  struct PathTrie {
+    typedef unsigned int NodeIndex;
+
+    enum : NodeIndex {
+      ROOT = 0,
+      NO_NODE = (NodeIndex)-1
+    };
+
+    PathTrie() {
+      // The root stands for the document itself; its name and path are empty
+      names_.push_back(std::string());
+      nodes_.push_back(Node(NO_NODE, 0));
+      paths_.push_back(std::string());
+    }
+
+    // Adds path and any missing prefixes of it; returns the node for path itself.
+    // Paths must be absolute; empty segments (e.g. from "//") are ignored.
+    NodeIndex Insert(const std::string& path) {
+      NodeIndex node = ROOT;
+      std::size_t begin = 0;
+
+      while (begin < path.size()) {
+        std::size_t end = path.find('/', begin);
+        if (end == std::string::npos) {
+          end = path.size();
+        }
+
+        if (end > begin) {
+          node = InsertChild(node, path.substr(begin, end - begin));
+        }
+        begin = end + 1;
+      }
+
+      return node;
+    }
+
+    // The child of parent named name, or NO_NODE. Never allocates.
+    NodeIndex Child(NodeIndex parent, const char* name) const {
+      for (NodeIndex i = nodes_[parent].firstChild; i != NO_NODE; i = nodes_[i].nextSibling) {
+        const std::string& candidate = names_[nodes_[i].name];
+        if (candidate[0] == name[0] && strcmp(candidate.c_str(), name) == 0) {
+          return i;
+        }
+      }
+      return NO_NODE;
+    }
+
+    NodeIndex Parent(NodeIndex node) const { return nodes_[node].parent; }
+    bool HasChildren(NodeIndex node) const { return nodes_[node].firstChild != NO_NODE; }
+
+    const std::string& Name(NodeIndex node) const { return names_[nodes_[node].name]; }
+    const std::string& Path(NodeIndex node) const { return paths_[node]; }
+
+    std::size_t Size() const { return nodes_.size(); }
+
+  private:
+    typedef unsigned int NameIndex;
+
+    struct Node {
+      NodeIndex parent;
+      NameIndex name;
+      NodeIndex firstChild;
+      NodeIndex nextSibling;
+
+      Node(NodeIndex parent, NameIndex name)
+        : parent(parent), name(name), firstChild(NO_NODE), nextSibling(NO_NODE)
+      {}
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<std::string> paths_;
+    std::vector<std::string> names_;
+    std::map<std::string, NameIndex> nameIndex_;
+
+    NodeIndex InsertChild(NodeIndex parent, const std::string& name) {
+      NodeIndex existing = Child(parent, name.c_str());
+      if (existing != NO_NODE) {
+        return existing;
+      }
+
+      NodeIndex node = (NodeIndex)nodes_.size();
+      nodes_.push_back(Node(parent, Intern(name)));
+      paths_.push_back(paths_[parent] + "/" + name);
+
+      // Children are chained in insertion order so that listeners registered first
+      // are matched first.
+      NodeIndex* link = &nodes_[parent].firstChild;
+      while (*link != NO_NODE) {
+        link = &nodes_[*link].nextSibling;
+      }
+      *link = node;
+
+      return node;
+    }
+
+    NameIndex Intern(const std::string& name) {
+      std::map<std::string, NameIndex>::const_iterator i = nameIndex_.find(name);
+      if (i != nameIndex_.end()) {
+        return i->second;
+      }
+
+      NameIndex index = (NameIndex)names_.size();
+      names_.push_back(name);
+      nameIndex_.insert(std::make_pair(name, index));
+      return index;
+    }
+  };
+
+} // james
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <james/expat-facade.hpp>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace james {
+
+  // The listeners of a StaticFacade handler. Each listener is a type naming the path it
+  // listens for:
+  //
+  //   struct Geometry { static const char* Path() { return "/COLLADA/library_geometries/geometry"; } };
+  //
+  // and the handler receives its events through public overloads taking that type first:
+  //
+  //   void Opened(Geometry, const Path&, const Attributes&);
+  //   void Closed(Geometry, const Path&);
+  //   void Text(Geometry, const Path&, const std::string&);
+  //   void Chunk(Geometry, const Path&, StringView);
+  //
+  // Any of the four may be left out. Text is only collected for listeners with a Text
+  // overload.
+  template <typename... Listeners>
+  struct ListenerList {
+    enum { SIZE = sizeof...(Listeners) };
+
+    template <std::size_t i>
+    using At = typename std::tuple_element<i, std::tuple<Listeners...>>::type;
+  };
+
+  namespace detail {
+
+    template <typename T>
+    struct Void { typedef void type; };
+
+    template <typename Handler, typename Listener, typename = void>
+    struct HasOpened : std::false_type {};
+
+    template <typename Handler, typename Listener>
+    struct HasOpened<Handler, Listener, typename Void<decltype(std::declval<Handler&>().Opened(
+      Listener(), std::declval<const Path&>(), std::declval<const Attributes&>()))>::type>
+      : std::true_type {};
+
+    template <typename Handler, typename Listener, typename = void>
+    struct HasClosed : std::false_type {};
+
+    template <typename Handler, typename Listener>
+    struct HasClosed<Handler, Listener, typename Void<decltype(std::declval<Handler&>().Closed(
+      Listener(), std::declval<const Path&>()))>::type>
+      : std::true_type {};
+
+    template <typename Handler, typename Listener, typename = void>
+    struct HasText : std::false_type {};
+
+    template <typename Handler, typename Listener>
+    struct HasText<Handler, Listener, typename Void<decltype(std::declval<Handler&>().Text(
+      Listener(), std::declval<const Path&>(), std::declval<const std::string&>()))>::type>
+      : std::true_type {};
+
+    template <typename Handler, typename Listener, typename = void>
+    struct HasChunk : std::false_type {};
+
+    template <typename Handler, typename Listener>
+    struct HasChunk<Handler, Listener, typename Void<decltype(std::declval<Handler&>().Chunk(
+      Listener(), std::declval<const Path&>(), std::declval<StringView>()))>::type>
+      : std::true_type {};
+
+    // One event, passed to whichever handler overload exists for the listener
+
+    struct OpenedEvent {
+      const Path& path;
+      const Attributes& attributes;
+
+      template <typename Handler, typename Listener>
+      void operator ()(Handler& handler, Listener listener) const {
+        Call(handler, listener, HasOpened<Handler, Listener>());
+      }
+
+      template <typename Handler, typename Listener>
+      void Call(Handler& handler, Listener listener, std::true_type) const {
+        handler.Opened(listener, path, attributes);
+      }
+
+      template <typename Handler, typename Listener>
+      void Call(Handler&, Listener, std::false_type) const {}
+    };
+
+    struct ClosedEvent {
+      const Path& path;
+
+      template <typename Handler, typename Listener>
+      void operator ()(Handler& handler, Listener listener) const {
+        Call(handler, listener, HasClosed<Handler, Listener>());
+      }
+
+      template <typename Handler, typename Listener>
+      void Call(Handler& handler, Listener listener, std::true_type) const {
+        handler.Closed(listener, path);
+      }
+
+      template <typename Handler, typename Listener>
+      void Call(Handler&, Listener, std::false_type) const {}
+    };
+
+    struct TextEvent {
+      const Path& path;
+      const std::string& text;
+
+      template <typename Handler, typename Listener>
+      void operator ()(Handler& handler, Listener listener) const {
+        Call(handler, listener, HasText<Handler, Listener>());
+      }
+
+      template <typename Handler, typename Listener>
+      void Call(Handler& handler, Listener listener, std::true_type) const {
+        handler.Text(listener, path, text);
+      }
+
+      template <typename Handler, typename Listener>
+      void Call(Handler&, Listener, std::false_type) const {}
+    };
+
+    struct ChunkEvent {
+      const Path& path;
+      StringView chunk;
+
+      template <typename Handler, typename Listener>
+      void operator ()(Handler& handler, Listener listener) const {
+        Call(handler, listener, HasChunk<Handler, Listener>());
+      }
+
+      template <typename Handler, typename Listener>
+      void Call(Handler& handler, Listener listener, std::true_type) const {
+        handler.Chunk(listener, path, chunk);
+      }
+
+      template <typename Handler, typename Listener>
+      void Call(Handler&, Listener, std::false_type) const {}
+    };
+
+  } // detail
+
+  // A facade whose listeners are fixed at compile time: each Handler lists them in a
+  // Listeners typedef (see ListenerList). Events are dispatched by a chain of comparisons
+  // the compiler generates from the lists, so handlers are called directly and can be
+  // inlined into the event loop - no std::function, no closures.
+  //
+  // The handlers are only referred to, and must outlive the facade.
+  template <typename... Handlers>
+  struct StaticFacade
+    : BasicFacade<StaticFacade<Handlers...>>
+  {
+    explicit StaticFacade(Handlers&... handlers)
+      : handlers_(handlers...), listeners_(1)
+    {
+      Registrar registrar = { *this, 0 };
+      while (registrar.index < LISTENER_COUNT) {
+        Visit<0, 0>(registrar.index, registrar);
+        registrar.index++;
+      }
+    }
+
+  private:
+    friend struct BasicFacade<StaticFacade>;
+
+    // Listeners are numbered through all the handlers' lists in order
+    typedef unsigned int ListenerIndex;
+
+    template <std::size_t h>
+    using HandlerAt = typename std::tuple_element<h, std::tuple<Handlers...>>::type;
+
+    template <std::size_t h, bool = (h < sizeof...(Handlers))>
+    struct ListenerCount
+      : std::integral_constant<std::size_t, HandlerAt<h>::Listeners::SIZE>
+    {};
+
+    template <std::size_t h>
+    struct ListenerCount<h, false>
+      : std::integral_constant<std::size_t, 0>
+    {};
+
+    template <std::size_t h = 0, bool = (h < sizeof...(Handlers))>
+    struct TotalListenerCount
+      : std::integral_constant<std::size_t, ListenerCount<h>::value + TotalListenerCount<h + 1>::value>
+    {};
+
+    template <std::size_t h>
+    struct TotalListenerCount<h, false>
+      : std::integral_constant<std::size_t, 0>
+    {};
+
+    enum : ListenerIndex { LISTENER_COUNT = TotalListenerCount<>::value };
+
+    enum { END, NEXT_HANDLER, LISTENER };
+
+    template <std::size_t h, std::size_t l>
+    struct Step
+      : std::integral_constant<int,
+        (h == sizeof...(Handlers)) ? END : (l == ListenerCount<h>::value) ? NEXT_HANDLER : LISTENER>
+    {};
+
+    struct Registrar {
+      StaticFacade& facade;
+      ListenerIndex index;
+
+      template <typename Handler, typename Listener>
+      void operator ()(Handler&, Listener) {
+        PathTrie::NodeIndex node = facade.AddPath(Listener::Path(),
+          detail::HasText<Handler, Listener>::value, detail::HasChunk<Handler, Listener>::value);
+
+        facade.listeners_.resize(facade.NodeCount());
+        facade.listeners_[node].push_back(index);
+      }
+    };
+
+    std::tuple<Handlers&...> handlers_;
+
+    // Listeners for each node of the path trie
+    std::vector<std::vector<ListenerIndex>> listeners_;
+
+    // Calls f(handler, listener) for the target'th listener, counting from listener l
+    // of handler h
+    template <std::size_t h, std::size_t l, typename F>
+    void Visit(ListenerIndex target, F& f) {
+      Visit<h, l>(target, f, Step<h, l>());
+    }
+
+    template <std::size_t h, std::size_t l, typename F>
+    void Visit(ListenerIndex, F&, std::integral_constant<int, END>) {}
+
+    template <std::size_t h, std::size_t l, typename F>
+    void Visit(ListenerIndex target, F& f, std::integral_constant<int, NEXT_HANDLER>) {
+      Visit<h + 1, 0>(target, f);
+    }
+
+    template <std::size_t h, std::size_t l, typename F>
+    void Visit(ListenerIndex target, F& f, std::integral_constant<int, LISTENER>) {
+      if (target == 0) {
+        typedef typename HandlerAt<h>::Listeners::template At<l> Listener;
+        f(std::get<h>(handlers_), Listener());
+      }
+      else {
+        Visit<h, l + 1>(target - 1, f);
+      }
+    }
+
+    template <typename Event>
+    void Dispatch(PathTrie::NodeIndex node, const Event& event) {
+      for (ListenerIndex listener : listeners_[node]) {
+        Visit<0, 0>(listener, event);
+      }
+    }
+
+    void Opened(PathTrie::NodeIndex node, const Path& path, const Attributes& attributes) {
+      Dispatch(node, detail::OpenedEvent{ path, attributes });
+    }
+
+    void Closed(PathTrie::NodeIndex node, const Path& path) {
+      Dispatch(node, detail::ClosedEvent{ path });
+    }
+
+    void Text(PathTrie::NodeIndex node, const Path& path, const std::string& text) {
+      Dispatch(node, detail::TextEvent{ path, text });
+    }
+
+    void Chunk(PathTrie::NodeIndex node, const Path& path, StringView chunk) {
+      Dispatch(node, detail::ChunkEvent{ path, chunk });
+    }
+  };
+
+} // james
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <james/expat-parser.hpp>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace james {
+
+  // A parser for the restricted XML that COLLADA documents use, driving the same
+  // XMLConsumer interface as ExpatParser. The whole document must be in memory. Markup
+  // is found with SSE2 scans where the build allows (see Accelerated), text is passed to
+  // the consumer straight out of the input wherever it needs no decoding, and skipped
+  // elements (XMLConsumer::SkipElement) are passed over without being tokenised.
+  //
+  // Documents using anything outside the profile make Parse throw Unsupported, after
+  // which they should be given to ExpatParser instead:
+  //   - a DOCTYPE (and so DTDs and entities other than the predefined ones)
+  //   - an encoding other than UTF-8 or US-ASCII
+  //
+  // Checking is less strict than expat's: well-formedness errors in the markup are
+  // reported, but characters are not validated.
+  struct SimdXmlParser {
+    struct Exception
+      : ParseError
+    {
+      Exception(const char* msg, size_t line)
+        : ParseError("SimdXmlParser::Exception", msg, line)
+      {}
+    };
+
+    struct Unsupported
+      : std::runtime_error
+    {
+      explicit Unsupported(const char* msg)
+        : std::runtime_error(msg)
+      {}
+    };
+
+    // DEFAULT_HANDLER isn't supported, as expat's default handler reports markup in
+    // ways this parser doesn't reproduce; the constructor throws Unsupported.
+    SimdXmlParser(ExpatParser::XMLConsumer&, RegisteredHandlers handlers = DEFAULT_HANDLERS_ONLY);
+
+    SimdXmlParser(const SimdXmlParser&) = delete;
+    SimdXmlParser& operator =(const SimdXmlParser&) = delete;
+
+    // Parses a complete document. Can only be called once per parser.
+    void Parse(const char* data, size_t length);
+
+    const ExpatParser::SkipStats& Skipped() const { return skipped_; }
+
+    // Whether this build scans with SIMD instructions rather than the scalar fallback
+    static bool Accelerated();
+
+  private:
+    // Element and attribute names, stored once each: like expat, the parser hands the
+    // consumer the same pointer every time it sees a name (see AttributeKey)
+    struct NameTable {
+      NameTable();
+
+      const char* Intern(const char* name, size_t length);
+
+    private:
+      struct Entry {
+        const char* name;
+        size_t length;
+      };
+
+      std::vector<Entry> entries_;
+      size_t count_;
+      std::deque<std::string> storage_;
+
+      void Grow();
+    };
+
+    ExpatParser::XMLConsumer& consumer_;
+    RegisteredHandlers handlers_;
+    bool done_;
+
+    const char* begin_;
+    const char* end_;
+
+    NameTable names_;
+
+    // Names and lengths of the open elements
+    std::vector<std::pair<const char*, size_t>> openElements_;
+
+    // Attributes of the element being opened: atts_ is what StartElement receives, and
+    // the decoded values are stored in attValues_
+    std::vector<const char*> atts_;
+    std::vector<size_t> attValueOffsets_;
+    std::string attValues_;
+
+    // Decoded text, comments and PIs
+    std::string scratch_;
+
+    ExpatParser::SkipStats skipped_;
+
+    const char* ParseProlog(const char* p);
+    const char* ParseDeclaration(const char* p);
+    const char* ParseContent(const char* p);
+    const char* ParseEpilog(const char* p);
+
+    const char* ParseStartTag(const char* p);
+    const char* ParseEndTag(const char* p);
+    const char* ParseComment(const char* p);
+    const char* ParseCData(const char* p);
+    const char* ParsePI(const char* p);
+    const char* ParseReference(const char* p, const char* limit, std::string& out);
+    const char* ParseAttributeValue(const char* p, const char* valueEnd, std::string& out);
+
+    const char* SkipContent(const char* tagStart, const char* p, const char* name, size_t length);
+
+    void CharacterData(const char* s, size_t length);
+
+    [[noreturn]] void Fail(const char* msg, const char* at) const;
+  };
+
+} // james
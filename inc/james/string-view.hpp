@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#  include <string_view>
+#endif
+
+namespace james {
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+  typedef std::string_view StringView;
+#else
+  // Stand-in for std::string_view on pre-C++17 toolchains; only the subset of the
+  // interface used by listeners is provided. Like std::string_view, it compares equal
+  // to a string literal or std::string with the same characters.
+  struct StringView {
+    StringView() : data_(""), size_(0) {}
+    StringView(const char* data, std::size_t size) : data_(data), size_(size) {}
+    StringView(const char* s) : data_(s), size_(strlen(s)) {}
+    StringView(const std::string& s) : data_(s.data()), size_(s.size()) {}
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+
+    char operator[](std::size_t i) const { return data_[i]; }
+
+  private:
+    const char* data_;
+    std::size_t size_;
+  };
+
+  inline bool operator ==(StringView a, StringView b) {
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+  }
+
+  inline bool operator !=(StringView a, StringView b) {
+    return !(a == b);
+  }
+#endif
+
+} // james
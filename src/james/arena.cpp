@@ -0,0 +1,156 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#  include <sys/mman.h>
+#endif
+
+namespace james {
+
+  namespace {
+
+    const std::size_t MIN_SIZE = 16;
+    const std::size_t FIRST_BLOCK_SIZE = 64 * 1024;
+    const std::size_t MAX_BLOCK_SIZE = 2 * 1024 * 1024;
+    const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    // Blocks' headers are padded so that what follows is aligned
+    const std::size_t BLOCK_HEADER_SIZE = 16;
+
+    // The size class of a small allocation: 0 for up to 16 bytes, 1 for up to 32...
+    int SizeClass(std::size_t size) {
+      int sizeClass = 0;
+      for (std::size_t classSize = MIN_SIZE; classSize < size; classSize *= 2) {
+        sizeClass++;
+      }
+      return sizeClass;
+    }
+
+    bool OnHugePages(std::size_t size, bool hugePages) {
+#ifdef __linux__
+      return hugePages && size >= HUGE_PAGE_SIZE;
+#else
+      (void)size;
+      (void)hugePages;
+      return false;
+#endif
+    }
+
+    void* SystemAllocate(std::size_t size, bool hugePages) {
+#ifdef __linux__
+      if (OnHugePages(size, hugePages)) {
+        std::size_t rounded = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+        void* p = nullptr;
+        if (posix_memalign(&p, HUGE_PAGE_SIZE, rounded) != 0) {
+          throw std::bad_alloc();
+        }
+
+        // Only advice: if the kernel won't, the memory is still good
+        madvise(p, rounded, MADV_HUGEPAGE);
+        return p;
+      }
+#endif
+      return ::operator new(size);
+    }
+
+    void SystemFree(void* p, std::size_t size, bool hugePages) {
+      if (OnHugePages(size, hugePages)) {
+        free(p);
+      }
+      else {
+        ::operator delete(p);
+      }
+    }
+
+  }
+
+  Arena::Arena(bool hugePages)
+    : blocks_(nullptr), next_(nullptr), end_(nullptr), blockBytes_(0), hugePages_(hugePages)
+  {
+    std::fill(free_, free_ + SIZE_CLASSES, nullptr);
+  }
+
+  Arena::~Arena() {
+    while (blocks_) {
+      Block* previous = blocks_->previous;
+      SystemFree(blocks_, blocks_->size, hugePages_);
+      blocks_ = previous;
+    }
+  }
+
+  void* Arena::Allocate(std::size_t size) {
+    if (size >= LARGE_ALLOCATION) {
+      return SystemAllocate(size, hugePages_);
+    }
+
+    int sizeClass = SizeClass(size);
+    if (free_[sizeClass]) {
+      Free* p = free_[sizeClass];
+      free_[sizeClass] = p->next;
+      return p;
+    }
+
+    std::size_t classSize = MIN_SIZE << sizeClass;
+    if ((std::size_t)(end_ - next_) < classSize) {
+      AddBlock();
+    }
+
+    char* p = next_;
+    next_ += classSize;
+    return p;
+  }
+
+  void Arena::Deallocate(void* p, std::size_t size) {
+    if (size >= LARGE_ALLOCATION) {
+      SystemFree(p, size, hugePages_);
+      return;
+    }
+
+    int sizeClass = SizeClass(size);
+    Free* f = static_cast<Free*>(p);
+    f->next = free_[sizeClass];
+    free_[sizeClass] = f;
+  }
+
+  void Arena::AddBlock() {
+    // Each block twice the last, up to MAX_BLOCK_SIZE; the first is big enough for
+    // any small allocation
+    std::size_t size = blocks_ ? std::min(blocks_->size * 2, MAX_BLOCK_SIZE) : FIRST_BLOCK_SIZE + BLOCK_HEADER_SIZE;
+
+    // What's left of the last block goes to the free lists, biggest pieces first
+    while (end_ - next_ >= (std::ptrdiff_t)MIN_SIZE) {
+      std::size_t piece = LARGE_ALLOCATION / 2;
+      while (piece > (std::size_t)(end_ - next_)) {
+        piece /= 2;
+      }
+      Deallocate(next_, piece);
+      next_ += piece;
+    }
+
+    Block* block = static_cast<Block*>(SystemAllocate(size, hugePages_));
+    block->previous = blocks_;
+    block->size = size;
+
+    blocks_ = block;
+    blockBytes_ += size;
+    next_ = reinterpret_cast<char*>(block) + BLOCK_HEADER_SIZE;
+    end_ = reinterpret_cast<char*>(block) + size;
+  }
+
+  thread_local Arena* Arena::current_ = nullptr;
+
+  ArenaScope::ArenaScope(Arena& arena)
+    : previous_(Arena::current_)
+  {
+    Arena::current_ = &arena;
+  }
+
+  ArenaScope::~ArenaScope() {
+    Arena::current_ = previous_;
+  }
+
+} // namespace james
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+namespace james {
+
+  // Memory for the temporaries of one load. Small allocations are carved out of blocks,
+  // rounded up to a power of two; freed ones are kept for the next allocation of the
+  // same size, and the blocks are only given back when the arena is destroyed.
+  // Allocations of LARGE_ALLOCATION bytes or more go to the system and back again when
+  // they're freed, so that big arrays don't outstay their use.
+  //
+  // With hugePages, system allocations of 2MB or more are backed by transparent huge
+  // pages where the platform has them (Linux).
+  //
+  // An arena may only be used by one thread at a time.
+  struct Arena {
+    static const std::size_t ALIGNMENT = 16;
+    static const std::size_t LARGE_ALLOCATION = 64 * 1024;
+
+    explicit Arena(bool hugePages = false);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator =(const Arena&) = delete;
+
+    // Aligned to ALIGNMENT
+    void* Allocate(std::size_t size);
+    void Deallocate(void* p, std::size_t size);
+
+    // Bytes held in blocks for small allocations
+    std::size_t BlockBytes() const { return blockBytes_; }
+
+    // The arena that ArenaAllocators made on this thread draw from by default, or null
+    static Arena* Current() { return current_; }
+
+  private:
+    // Sizes 16, 32, ... up to LARGE_ALLOCATION
+    static const int SIZE_CLASSES = 13;
+
+    struct Block {
+      Block* previous;
+      std::size_t size;
+    };
+
+    struct Free {
+      Free* next;
+    };
+
+    Block* blocks_;
+    char* next_;
+    char* end_;
+    Free* free_[SIZE_CLASSES];
+    std::size_t blockBytes_;
+    bool hugePages_;
+
+    static thread_local Arena* current_;
+
+    void AddBlock();
+
+    friend struct ArenaScope;
+  };
+
+  // Makes an arena the current one on this thread for the scope's lifetime
+  struct ArenaScope {
+    explicit ArenaScope(Arena& arena);
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator =(const ArenaScope&) = delete;
+
+  private:
+    Arena* previous_;
+  };
+
+  // A standard allocator drawing from an arena, or from the heap if it has none. A
+  // default-constructed one takes the thread's current arena.
+  template <typename T>
+  struct ArenaAllocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator() : arena(Arena::Current()) {}
+    explicit ArenaAllocator(Arena* arena) : arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    static_assert(alignof(T) <= Arena::ALIGNMENT, "Arena allocations aren't aligned for T");
+
+    T* allocate(std::size_t n) {
+      return static_cast<T*>(arena ? arena->Allocate(n * sizeof(T)) : ::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) {
+      if (arena) {
+        arena->Deallocate(p, n * sizeof(T));
+      }
+      else {
+        ::operator delete(p);
+      }
+    }
+
+    Arena* arena;
+  };
+
+  template <typename T, typename U>
+  bool operator ==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+
+  template <typename T, typename U>
+  bool operator !=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+} // namespace james
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include "bounds.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define BOUNDS_SSE2 1
+#  include <emmintrin.h>
+#endif
+
+namespace james {
+
+  namespace {
+
+    float DistanceSquared(const float* a, const float* b) {
+      float d[3] = { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+      return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    }
+
+#ifdef BOUNDS_SSE2
+    // The coordinates of points i to i + 3, a component to a register. Each point is
+    // loaded as four floats, so the one after point i + 3 must exist.
+    struct FourPoints {
+      __m128 x, y, z;
+
+      FourPoints(const float* points, std::size_t stride, std::size_t i) {
+        __m128 a = _mm_loadu_ps(points + i * stride);
+        __m128 b = _mm_loadu_ps(points + (i + 1) * stride);
+        __m128 c = _mm_loadu_ps(points + (i + 2) * stride);
+        __m128 d = _mm_loadu_ps(points + (i + 3) * stride);
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        x = a;
+        y = b;
+        z = c;
+      }
+
+      __m128 DistanceSquared(__m128 cx, __m128 cy, __m128 cz) const {
+        __m128 dx = _mm_sub_ps(x, cx);
+        __m128 dy = _mm_sub_ps(y, cy);
+        __m128 dz = _mm_sub_ps(z, cz);
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+      }
+    };
+
+    __m128 Select(__m128 mask, __m128 a, __m128 b) {
+      return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    __m128i Select(__m128 mask, __m128i a, __m128i b) {
+      __m128i m = _mm_castps_si128(mask);
+      return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+    }
+#endif
+
+    // The box, and the first point on each of its faces: extremes[c] on min[c] and
+    // extremes[3 + c] on max[c]
+    void BoundBox(const float* points, std::size_t stride, std::size_t count, Bounds& out,
+      std::size_t* extremes
+    ) {
+      for (int c = 0; c < 3; c++) {
+        out.min[c] = out.max[c] = points[c];
+        extremes[c] = extremes[3 + c] = 0;
+      }
+
+      std::size_t i = 1;
+
+#ifdef BOUNDS_SSE2
+      // Four points at a time, each lane keeping the first of its own extremes, and then
+      // the lanes' extremes are merged. The last point is always left to the loop after.
+      if (count > 5) {
+        __m128 low[3], high[3];
+        __m128i lowAt[3], highAt[3];
+        for (int c = 0; c < 3; c++) {
+          low[c] = high[c] = _mm_set1_ps(points[c]);
+          lowAt[c] = highAt[c] = _mm_setzero_si128();
+        }
+
+        __m128i at = _mm_setr_epi32(1, 2, 3, 4);
+        const __m128i four = _mm_set1_epi32(4);
+
+        for (; i + 4 < count; i += 4) {
+          FourPoints p(points, stride, i);
+          const __m128 v[3] = { p.x, p.y, p.z };
+
+          for (int c = 0; c < 3; c++) {
+            __m128 below = _mm_cmplt_ps(v[c], low[c]);
+            __m128 above = _mm_cmpgt_ps(v[c], high[c]);
+            low[c] = Select(below, v[c], low[c]);
+            high[c] = Select(above, v[c], high[c]);
+            lowAt[c] = Select(below, at, lowAt[c]);
+            highAt[c] = Select(above, at, highAt[c]);
+          }
+          at = _mm_add_epi32(at, four);
+        }
+
+        for (int c = 0; c < 3; c++) {
+          float lows[4], highs[4];
+          std::uint32_t lowsAt[4], highsAt[4];
+          _mm_storeu_ps(lows, low[c]);
+          _mm_storeu_ps(highs, high[c]);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(lowsAt), lowAt[c]);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(highsAt), highAt[c]);
+
+          for (int lane = 0; lane < 4; lane++) {
+            if (lows[lane] < out.min[c] || (lows[lane] == out.min[c] && lowsAt[lane] < extremes[c])) {
+              out.min[c] = lows[lane];
+              extremes[c] = lowsAt[lane];
+            }
+            if (highs[lane] > out.max[c] || (highs[lane] == out.max[c] && highsAt[lane] < extremes[3 + c])) {
+              out.max[c] = highs[lane];
+              extremes[3 + c] = highsAt[lane];
+            }
+          }
+        }
+      }
+#endif
+
+      for (; i < count; i++) {
+        const float* p = points + i * stride;
+        for (int c = 0; c < 3; c++) {
+          if (p[c] < out.min[c]) {
+            out.min[c] = p[c];
+            extremes[c] = i;
+          }
+          if (p[c] > out.max[c]) {
+            out.max[c] = p[c];
+            extremes[3 + c] = i;
+          }
+        }
+      }
+    }
+
+    void Grow(const float* p, float* center, float& radius) {
+      float d = std::sqrt(DistanceSquared(p, center));
+      float grow = (d - radius) / 2;
+      for (int c = 0; c < 3; c++) {
+        center[c] += (p[c] - center[c]) * (grow / d);
+      }
+      radius += grow;
+    }
+
+    // Ritter's sphere: about the widest pair of extremes, grown to take in each point
+    // outside it in turn
+    void GrowSphere(const float* points, std::size_t stride, std::size_t count,
+      const std::size_t* extremes, float* center, float& radius
+    ) {
+      const float* a = points;
+      const float* b = points;
+      for (int c = 0; c < 3; c++) {
+        const float* low = points + extremes[c] * stride;
+        const float* high = points + extremes[3 + c] * stride;
+        if (DistanceSquared(low, high) > DistanceSquared(a, b)) {
+          a = low;
+          b = high;
+        }
+      }
+
+      for (int c = 0; c < 3; c++) {
+        center[c] = (a[c] + b[c]) / 2;
+      }
+      radius = std::sqrt(DistanceSquared(a, b)) / 2;
+
+      std::size_t i = 0;
+
+#ifdef BOUNDS_SSE2
+      // Most points are inside already; four at a time are checked, and only the few
+      // groups with a point outside are gone through one by one
+      for (; i + 4 < count; i += 4) {
+        FourPoints p(points, stride, i);
+        __m128 d = p.DistanceSquared(_mm_set1_ps(center[0]), _mm_set1_ps(center[1]), _mm_set1_ps(center[2]));
+        if (_mm_movemask_ps(_mm_cmpgt_ps(d, _mm_set1_ps(radius * radius))) == 0) {
+          continue;
+        }
+
+        for (std::size_t j = i; j < i + 4; j++) {
+          const float* q = points + j * stride;
+          if (DistanceSquared(q, center) > radius * radius) {
+            Grow(q, center, radius);
+          }
+        }
+      }
+#endif
+
+      for (; i < count; i++) {
+        const float* p = points + i * stride;
+        if (DistanceSquared(p, center) > radius * radius) {
+          Grow(p, center, radius);
+        }
+      }
+    }
+
+    // The squared distances from a and from b to the points farthest from each
+    void Farthest(const float* points, std::size_t stride, std::size_t count,
+      const float* a, const float* b, float& fromA, float& fromB
+    ) {
+      fromA = fromB = 0;
+      std::size_t i = 0;
+
+#ifdef BOUNDS_SSE2
+      __m128 farA = _mm_setzero_ps();
+      __m128 farB = _mm_setzero_ps();
+      const __m128 ax = _mm_set1_ps(a[0]), ay = _mm_set1_ps(a[1]), az = _mm_set1_ps(a[2]);
+      const __m128 bx = _mm_set1_ps(b[0]), by = _mm_set1_ps(b[1]), bz = _mm_set1_ps(b[2]);
+
+      for (; i + 4 < count; i += 4) {
+        FourPoints p(points, stride, i);
+        farA = _mm_max_ps(farA, p.DistanceSquared(ax, ay, az));
+        farB = _mm_max_ps(farB, p.DistanceSquared(bx, by, bz));
+      }
+
+      float lanesA[4], lanesB[4];
+      _mm_storeu_ps(lanesA, farA);
+      _mm_storeu_ps(lanesB, farB);
+      for (int lane = 0; lane < 4; lane++) {
+        fromA = (lanesA[lane] > fromA) ? lanesA[lane] : fromA;
+        fromB = (lanesB[lane] > fromB) ? lanesB[lane] : fromB;
+      }
+#endif
+
+      for (; i < count; i++) {
+        const float* p = points + i * stride;
+        float dA = DistanceSquared(p, a);
+        float dB = DistanceSquared(p, b);
+        fromA = (dA > fromA) ? dA : fromA;
+        fromB = (dB > fromB) ? dB : fromB;
+      }
+    }
+
+  }
+
+  void BoundPoints(const float* points, std::size_t stride, std::size_t count, Bounds& out) {
+    memset(&out, 0, sizeof(out));
+    if (count == 0) {
+      return;
+    }
+
+    std::size_t extremes[6];
+    BoundBox(points, stride, count, out, extremes);
+
+    float center[3];
+    float radius;
+    GrowSphere(points, stride, count, extremes, center, radius);
+
+    // Growing leaves the sphere larger than it needs to be: it's shrunk to the farthest
+    // point, and swapped for the box's if that's smaller still
+    float boxCenter[3];
+    for (int c = 0; c < 3; c++) {
+      boxCenter[c] = (out.min[c] + out.max[c]) / 2;
+    }
+
+    float grown, boxed;
+    Farthest(points, stride, count, center, boxCenter, grown, boxed);
+
+    const float* best = (grown <= boxed) ? center : boxCenter;
+    for (int c = 0; c < 3; c++) {
+      out.center[c] = best[c];
+    }
+    out.radius = std::sqrt((grown <= boxed) ? grown : boxed);
+  }
+
+} // namespace james
\ No newline at end of file
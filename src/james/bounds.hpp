@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+namespace james {
+
+  // A box, aligned with the axes, and a sphere that each hold all of a set of points.
+  // The bounds of no points are all zeros.
+  struct Bounds {
+    float min[3];
+    float max[3];
+    float center[3];
+    float radius;
+  };
+
+  // Bounds count points of three floats each, the first at points and each one stride
+  // floats after the last. The box is exact. The sphere is the smaller of Ritter's, grown
+  // from the two of the box's extreme points that are farthest apart, and the one about
+  // the box's center; it's close to the smallest, but not always it.
+  void BoundPoints(const float* points, std::size_t stride, std::size_t count, Bounds& out);
+
+} // namespace james
\ No newline at end of file
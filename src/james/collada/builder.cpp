@@ -27,18 +27,12 @@ namespace collada {
 
   }
 
-  Builder::Builder(ExpatFacade& src)
-    : libGeometriesBuilder_(src)
-  {
-
-    src.ListenFor("/COLLADA", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-        CheckMaxVersion(1, 4, attr["version"]);
-      })
-      .Closed([this](const Path& p) {
-      })
-    );
+  Builder::Builder()
+    : facade_(*this, libGeometriesBuilder_)
+  {}
 
+  void Builder::Opened(Collada, const Path&, const Attributes& attr) {
+    CheckMaxVersion(1, 4, attr["version"]);
   }
 
 } // namespace collada
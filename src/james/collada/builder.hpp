@@ -1,16 +1,49 @@
 #pragma once
 
-#include <james/expat-facade.hpp>
+#include <james/expat-static-facade.hpp>
 #include "lib-geometries-builder.hpp"
 
 namespace james {
 namespace collada {
 
   struct Builder {
-    Builder(ExpatFacade&);
+    Builder();
+
+    Builder(const Builder&) = delete;
+    Builder& operator =(const Builder&) = delete;
+
+    // Where the parser should send its events
+    ExpatParser::XMLConsumer& XMLConsumer() { return facade_.XMLConsumer(); }
+
+    // See LibGeometriesBuilder::DeferDecoding
+    void DeferDecoding() { libGeometriesBuilder_.DeferDecoding(); }
+    void DecodeDeferred(unsigned int threads) { libGeometriesBuilder_.DecodeDeferred(threads); }
+
+    // See LibGeometriesBuilder::KeepStrips
+    void KeepStrips() { libGeometriesBuilder_.KeepStrips(); }
+
+    // See LibGeometriesBuilder::EmitModel
+    void EmitModel() { libGeometriesBuilder_.EmitModel(); }
+    Model3d TakeModel(const VertexEncoding& encoding = VertexEncoding()) {
+      return libGeometriesBuilder_.TakeModel(encoding);
+    }
+    void OptimizeMeshes(unsigned int threads, MeshOptimizationReport* report) {
+      libGeometriesBuilder_.OptimizeMeshes(threads, report);
+    }
+    void BuildMeshlets(unsigned int threads, unsigned int maxVertices, unsigned int maxTriangles) {
+      libGeometriesBuilder_.BuildMeshlets(threads, maxVertices, maxTriangles);
+    }
+
+    // Listeners, for StaticFacade
+    struct Collada { static const char* Path() { return "/COLLADA"; } };
+
+    typedef ListenerList<Collada> Listeners;
+
+    void Opened(Collada, const Path&, const Attributes&);
 
   private:
     LibGeometriesBuilder libGeometriesBuilder_;
+    StaticFacade<Builder, LibGeometriesBuilder> facade_;
   };
 
 } // namespace collada
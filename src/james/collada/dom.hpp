@@ -3,20 +3,41 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <utility>
+#include "../arena.hpp"
+#include "../bounds.hpp"
 
 namespace james {
 namespace collada {
 
-  using std::string;
-  using std::vector;
-  using std::map;
+  // Everything built while parsing is allocated from the load's arena; see ArenaScope
+  typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> string;
+
+  template <typename T>
+  using vector = std::vector<T, ArenaAllocator<T>>;
+
+  template <typename K, typename V>
+  using map = std::map<K, V, std::less<K>, ArenaAllocator<std::pair<const K, V>>>;
 
   typedef vector<float> FloatSource;
 
+  // An id in the document, by its number in the document's IdTable
+  typedef unsigned int Id;
+
+  const Id NO_ID = (Id)-1;
+
+  // A <float_array>
+  struct Source {
+    Id id;
+    FloatSource data;
+  };
+
+  // The <accessor> of a <source>
   struct Accessor {
     static const size_t NOT_PRESENT = (size_t)-1;
 
-    string source;
+    Id id;           // Of the <source>
+    size_t source;   // Index into the mesh's sources, or NOT_PRESENT
 
     size_t count;
     size_t stride;
@@ -27,53 +48,74 @@ namespace collada {
     size_t cIndex;
 
     Accessor()
-      : count(0), stride(0), offset(0), aIndex(NOT_PRESENT), bIndex(NOT_PRESENT), cIndex(NOT_PRESENT)
+      : id(NO_ID), source(NOT_PRESENT), count(0), stride(0), offset(0),
+        aIndex(NOT_PRESENT), bIndex(NOT_PRESENT), cIndex(NOT_PRESENT)
     {}
   };
 
   struct VertexLink {
-    string id;
-    string accessor;
+    Id id;
+    size_t accessor;   // Index into the mesh's accessors, or Accessor::NOT_PRESENT
+
+    VertexLink() : id(NO_ID), accessor(Accessor::NOT_PRESENT) {}
   };
 
+  // A <p> index that ends one strip of a TRIANGLE_STRIP part and starts the next: a
+  // corner whose indices are all RESTART_INDEX
+  const unsigned int RESTART_INDEX = (unsigned int)-1;
+
+  // A <polylist>, <triangles>, <polygons>, <tristrips> or <trifans>, with its polygons
+  // as triangles. Each corner is stride indices, one for each input.
   struct VertexIndex {
     typedef vector<unsigned int> IndexList;
 
+    enum Topology {
+      // Each three corners are a triangle
+      TRIANGLES,
+      // Strips, kept as they were in <tristrips>, separated by restarts
+      TRIANGLE_STRIP
+    };
+
     struct Input {
-      string accessor;
+      size_t accessor;   // Index into the mesh's accessors, or Accessor::NOT_PRESENT
       size_t offset;
 
-      Input() : offset(0) {}
+      Input() : accessor(Accessor::NOT_PRESENT), offset(0) {}
     };
 
     string material;
-    Input position;
+    Input position;       // Through <vertices>
     Input normals;
     Input texCoords;
+    size_t stride;        // Indices per vertex: one more than the largest input offset
+    Topology topology;
     IndexList indices;
+    Bounds bounds;        // Of the positions its corners use; see BoundPart
+
+    VertexIndex() : stride(0), topology(TRIANGLES), bounds() {}
   };
 
   struct Mesh {
-    typedef map<string, FloatSource> SourceMap;
-    typedef map<string, Accessor> AccessorMap;
+    typedef vector<Source> SourceList;
+    typedef vector<Accessor> AccessorList;
     typedef vector<VertexIndex> VertexIndexList;
 
     Mesh() {}
-    Mesh(SourceMap&& sources, AccessorMap&& accessors, VertexLink&& vertices, VertexIndexList&& parts)
-      : sources_(sources), accessors_(accessors), vertices_(vertices), parts_(parts)
+    Mesh(SourceList&& sources, AccessorList&& accessors, VertexLink&& vertices, VertexIndexList&& parts)
+      : sources_(std::move(sources)), accessors_(std::move(accessors)), vertices_(std::move(vertices)), parts_(std::move(parts))
     {}
-    Mesh(const SourceMap& sources, const AccessorMap& accessors, const VertexLink& vertices, const VertexIndexList& parts)
+    Mesh(const SourceList& sources, const AccessorList& accessors, const VertexLink& vertices, const VertexIndexList& parts)
       : sources_(sources), accessors_(accessors), vertices_(vertices), parts_(parts)
     {}
 
-    const SourceMap& Sources() const { return sources_; }
-    const AccessorMap& Accessors() const { return accessors_; }
+    const SourceList& Sources() const { return sources_; }
+    const AccessorList& Accessors() const { return accessors_; }
     const VertexLink& Vertices() const { return vertices_; }
     const VertexIndexList& Parts() const { return parts_; }
 
   private:
-    SourceMap sources_;
-    AccessorMap accessors_;
+    SourceList sources_;
+    AccessorList accessors_;
     VertexLink vertices_;
     VertexIndexList parts_;
   };
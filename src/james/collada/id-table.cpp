@@ -0,0 +1,112 @@
+#include "id-table.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace james {
+namespace collada {
+
+  namespace {
+
+    const size_t FIRST_SLOTS = 64;
+
+    const char* StripFragment(const char* name) {
+      return (name[0] == '#') ? name + 1 : name;
+    }
+
+    // A word at a time: ids are mostly longer than a word
+    uint32_t Hash(const char* name, size_t length) {
+      uint64_t h = length * 0x9e3779b97f4a7c15ull;
+
+      for (; length >= 8; name += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, name, 8);
+        h = (h ^ word) * 0xc2b2ae3d27d4eb4full;
+        h ^= h >> 29;
+      }
+
+      uint64_t tail = 0;
+      memcpy(&tail, name, length);
+      h = (h ^ tail) * 0x165667b19e3779f9ull;
+      return (uint32_t)(h ^ (h >> 32));
+    }
+
+  }
+
+  IdTable::IdTable()
+    : mask_(FIRST_SLOTS - 1)
+  {
+    Slot empty = { 0, NO_ID };
+    slots_.assign(FIRST_SLOTS, empty);
+  }
+
+  Id IdTable::Intern(const char* name) {
+    name = StripFragment(name);
+    size_t length = strlen(name);
+    uint32_t hash = Hash(name, length);
+
+    Slot& slot = slots_[Find(name, length, hash)];
+    if (slot.id != NO_ID) {
+      return slot.id;
+    }
+
+    Id id = (Id)starts_.size();
+    starts_.push_back(text_.size());
+    text_.append(name, length);
+    text_.push_back('\0');
+
+    slot.hash = hash;
+    slot.id = id;
+
+    if (starts_.size() * 2 > slots_.size()) {
+      Grow();
+    }
+    return id;
+  }
+
+  Id IdTable::Find(const char* name) const {
+    name = StripFragment(name);
+    size_t length = strlen(name);
+    return slots_[Find(name, length, Hash(name, length))].id;
+  }
+
+  size_t IdTable::Length(Id id) const {
+    size_t end = (id + 1 < starts_.size()) ? starts_[id + 1] : text_.size();
+    return end - starts_[id] - 1;
+  }
+
+  size_t IdTable::Find(const char* name, size_t length, uint32_t hash) const {
+    size_t slot = hash & mask_;
+
+    for (;;) {
+      const Slot& s = slots_[slot];
+      if (s.id == NO_ID
+        || (s.hash == hash && Length(s.id) == length && memcmp(Name(s.id), name, length) == 0)
+      ) {
+        return slot;
+      }
+      slot = (slot + 1) & mask_;
+    }
+  }
+
+  void IdTable::Grow() {
+    vector<Slot> old(std::move(slots_));
+
+    Slot empty = { 0, NO_ID };
+    slots_.assign(old.size() * 2, empty);
+    mask_ = slots_.size() - 1;
+
+    for (const Slot& s : old) {
+      if (s.id != NO_ID) {
+        size_t slot = s.hash & mask_;
+        while (slots_[slot].id != NO_ID) {
+          slot = (slot + 1) & mask_;
+        }
+        slots_[slot] = s;
+      }
+    }
+  }
+
+} // namespace collada
+} // namespace james
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include "dom.hpp"
+
+namespace james {
+namespace collada {
+
+  // The ids of a document, each stored once and known by its number. A URI fragment
+  // ("#id") stands for the id it refers to.
+  struct IdTable {
+    IdTable();
+
+    // The Id of name, numbering it if it hasn't been seen
+    Id Intern(const char* name);
+
+    // The Id of name, or NO_ID if it hasn't been seen
+    Id Find(const char* name) const;
+
+    // Valid until the next Intern
+    const char* Name(Id id) const { return text_.data() + starts_[id]; }
+
+    size_t Size() const { return starts_.size(); }
+
+  private:
+    string text_;             // The names, each followed by a NUL
+    vector<size_t> starts_;   // Of each name in text_, by Id
+
+    // Open addressing with linear probing, at most half full. Each slot keeps its name's
+    // hash, so that probing seldom has to look at the names.
+    struct Slot {
+      uint32_t hash;
+      Id id;
+    };
+
+    vector<Slot> slots_;
+    size_t mask_;
+
+    size_t Length(Id id) const;
+
+    // The slot holding name, or the empty one where it would go
+    size_t Find(const char* name, size_t length, uint32_t hash) const;
+
+    void Grow();
+  };
+
+} // namespace collada
+} // namespace james
@@ -1,263 +1,625 @@
 #include "lib-geometries-builder.hpp"
 
+#include "numeric-text.hpp"
+#include "write-mesh-3d.hpp"
+#include "../meshlets.hpp"
+#include "../parallel-for.hpp"
+#include <algorithm>
+#include <numeric>
+
 using namespace std;
 
 namespace james {
 namespace collada {
 
-  LibGeometriesBuilder::LibGeometriesBuilder(ExpatFacade& src) {
+  LibGeometriesBuilder::Keys::Keys()
+    : id("id"), source("source"), count("count"), stride("stride"), offset("offset"),
+      name("name"), type("type"), semantic("semantic"), material("material")
+  {}
 
-    ResetAccumulators();
+  namespace {
 
-    // Listener 1: /COLLADA/library_geometries/geometry
-    //
-    // Two jobs:
-    // (1) Store the id attribute in <geometry>
-    // (2) Save the mesh to this->meshes_ in </geometry>
-
-    src.ListenFor("/COLLADA/library_geometries/geometry", Tag()
-      .Opened([this](const Path& p, const Attributes& attr) {
-        const char* tmpId = attr["id"];
-        if (tmpId) {
-          currentMesh_.id = tmpId;
-        }
-      })
-      .Closed([this](const Path& p) {
-        // We don't support meshes without IDs or empty meshes.
-        // FIXME: ought to report this to caller somehow - it's probably not a fatal
-        //        error in most cases so need some warning/logging mechanism
-        if (currentMesh_.id.size() > 0 && currentMesh_.parts.size() > 0) {
-          meshes_.insert(make_pair(
-            currentMesh_.id,
-            Mesh(move(currentMesh_.sources), move(currentMesh_.accessors), move(currentMesh_.vertexLink), move(currentMesh_.parts))
-          ));
-        }
-        ResetAccumulators();
-      })
-    );
+    // Deferred payloads bigger than this are split so that one large array can be
+    // decoded by several threads
+    const size_t DECODE_PIECE_SIZE = 1024 * 1024;
 
-    // Listener 2: /COLLADA/library_geometries/geometry/mesh/source/float_array
-    //
-    // Three tasks:
-    // (a) Store the id attribute
-    // (b) Accumulate the array text (remembering that .Text may be called more than once if
-    //     extra tags appear within the <float_array> tag)
-    // (c) Once all the text is accumulated, convert it to an array of floats and store it
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/source/float_array", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-      const char* tmpId = attr["id"];
-      if (tmpId) {
-        currentSource_.id = tmpId;
+    // Counts from the document are only trusted this far when presizing, before the
+    // text has borne them out
+    const size_t MAX_PRESIZE = 4 * 1024 * 1024;
+
+    template <typename T>
+    void Presize(vector<T>& v, size_t count) {
+      v.reserve(min(count, MAX_PRESIZE));
+    }
+
+    // The decoders, bound to their outputs for NumericChunks
+
+    struct FloatsTo {
+      FloatSource& out;
+
+      bool operator ()(const char* begin, const char* end) const {
+        return DecodeFloats(begin, end, out);
       }
-    })
-      .Text([this](const Path&, const string& s) {
-      // In a valid COLLADA document it is unlikely (?invalid) that <float_array> has
-      // any children; however, for robustness (& in case my reading of the spec is wrong)
-      // we handle this case by simply accumulating all text until the end tag is found.
-      currentSource_.buffer << s;
-    })
-      .Closed([this](const Path&) {
-      if (currentSource_.id.size() > 0) {
-        FloatSource src;
-        float f;
-
-        while (currentSource_.buffer >> f) {
-          src.push_back(f);
-        }
+    };
 
-        if (src.size() > 0) {
-          currentMesh_.sources.insert(make_pair(currentSource_.id, src));
-        }
+    struct IndicesTo {
+      VertexIndex::IndexList& out;
+
+      bool operator ()(const char* begin, const char* end) const {
+        return DecodeIndices(begin, end, out);
+      }
+    };
+
+    struct PolygonsTo {
+      PolygonTriangulator& out;
+
+      bool operator ()(const char* begin, const char* end) const {
+        return DecodePolygons(begin, end, out);
+      }
+    };
+
+    struct VCountTo {
+      PolygonCounts& out;
+
+      bool operator ()(const char* begin, const char* end) const {
+        return DecodeVCount(begin, end, out);
+      }
+    };
+
+  }
+
+  LibGeometriesBuilder::LibGeometriesBuilder()
+    : geometry_(0), deferred_(false), emitModel_(false), keepStrips_(false)
+  {
+    ResetAccumulators();
+  }
+
+  void LibGeometriesBuilder::DeferDecoding() {
+    deferred_ = true;
+  }
+
+  void LibGeometriesBuilder::KeepStrips() {
+    keepStrips_ = true;
+  }
+
+  void LibGeometriesBuilder::EmitModel() {
+    emitModel_ = true;
+  }
+
+  // Listener 1: /COLLADA/library_geometries/geometry
+  //
+  // Two jobs:
+  // (1) Store the id attribute in <geometry>
+  // (2) Save the mesh to this->meshes_ in </geometry>
+
+  void LibGeometriesBuilder::Opened(Geometry, const Path&, const Attributes& attr) {
+    const char* tmpId = attr[keys_.id];
+    if (tmpId) {
+      currentMesh_.id = tmpId;
+    }
+  }
+
+  void LibGeometriesBuilder::Closed(Geometry, const Path&) {
+    if (deferred_) {
+      // Which parts and meshes to keep is decided in DecodeDeferred
+      DeferredGeometry geometry;
+      geometry.mesh = move(currentMesh_);
+
+      deferredGeometries_.push_back(move(geometry));
+      ResetAccumulators();
+      return;
+    }
+
+    // We don't support meshes without IDs or empty meshes.
+    // FIXME: ought to report this to caller somehow - it's probably not a fatal
+    //        error in most cases so need some warning/logging mechanism
+    if (currentMesh_.id.size() > 0 && currentMesh_.parts.size() > 0) {
+      meshes_.insert(make_pair(
+        currentMesh_.id,
+        Mesh(move(currentMesh_.sources), move(currentMesh_.accessors), move(currentMesh_.vertexLink), move(currentMesh_.parts))
+      ));
+    }
+    ResetAccumulators();
+  }
+
+  // Listener 2: /COLLADA/library_geometries/geometry/mesh/source/float_array
+  //
+  // Three tasks:
+  // (a) Store the id attribute
+  // (b) Decode the array text as it arrives (remembering that it may come in several
+  //     chunks, with a number split between two)
+  // (c) Once all the text is decoded, store the array of floats
+
+  void LibGeometriesBuilder::Opened(FloatArray, const Path&, const Attributes& attr) {
+    const char* tmpId = attr[keys_.id];
+    if (tmpId && tmpId[0]) {
+      currentSource_.id = ids_.Intern(tmpId);
+    }
+
+    const char* count = attr[keys_.count];
+    if (count) {
+      currentSource_.count = strtoul(count, nullptr, 0);
+    }
+
+    if (!deferred_ && currentSource_.id != NO_ID) {
+      Presize(currentSource_.floats, currentSource_.count);
+      numericText_.Clear();
+    }
+  }
+
+  void LibGeometriesBuilder::Chunk(FloatArray, const Path&, StringView s) {
+    // In a valid COLLADA document it is unlikely (?invalid) that <float_array> has
+    // any children; however, for robustness (& in case my reading of the spec is wrong)
+    // we handle this case by simply decoding all text until the end tag is found.
+    if (deferred_) {
+      currentPayload_.Append(s);
+    }
+    else if (currentSource_.id != NO_ID) {
+      numericText_.Append(s.data(), s.data() + s.size(), FloatsTo{ currentSource_.floats });
+    }
+  }
+
+  void LibGeometriesBuilder::Closed(FloatArray, const Path&) {
+    if (deferred_) {
+      // The source is given its place now, and its numbers in DecodeDeferred. As when
+      // decoding while parsing, an array with no numbers isn't bound, leaving its id
+      // to a later one.
+      if (currentSource_.id != NO_ID && DecodesAnyFloat(currentPayload_.Begin(), currentPayload_.End())
+        && Bind(sourceBindings_, currentSource_.id, currentMesh_.sources.size())
+      ) {
+        collada::Source source;
+        source.id = currentSource_.id;
+        currentMesh_.sources.push_back(move(source));
+
+        Defer(DeferredPayload::FLOATS, currentMesh_.sources.size() - 1, currentSource_.count);
       }
       ResetSourceAccumulator();
-    })
-      );
+      return;
+    }
 
-    // Listener 3+4+5:
-    //    /COLLADA/library_geometries/geometry/mesh/source
-    //    /COLLADA/library_geometries/geometry/mesh/source/technique_common/accessor
-    //    /COLLADA/library_geometries/geometry/mesh/source/technique_common/accessor/param
-    //
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/source", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-        const char* tmpId = attr["id"];
-        if (tmpId) {
-          currentAccessor_.id = tmpId;
-        }
-      })
-      .Closed([this](const Path&) {
-        if (currentAccessor_.id.size() > 0 && currentAccessor_.nParamsFound > 0) {
-          currentMesh_.accessors.insert(make_pair(currentAccessor_.id, currentAccessor_.data));
-        }
-        ResetAccessorAccumulator();
-      })
-    );
-
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/source/technique_common/accessor", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-        const char* source = attr["source"];
-        const char* count = attr["count"];
-        const char* stride = attr["stride"];
-        const char* offset = attr["offset"];
-
-        if (source) {
-          currentAccessor_.data.source = source;
-        }
+    if (currentSource_.id != NO_ID) {
+      numericText_.Finish(FloatsTo{ currentSource_.floats });
 
-        if (count) { currentAccessor_.data.count = strtoul(count, nullptr, 0); }
-        if (stride) { currentAccessor_.data.stride = strtoul(stride, nullptr, 0); }
-        if (offset) { currentAccessor_.data.offset = strtoul(offset, nullptr, 0); }
-      })
-    );
-
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/source/technique_common/accessor/param", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-        // Notes re: COLLADA accessors (the spec is quite complicated & several variants are possible)
-        // See https://www.khronos.org/collada/wiki/Using_accessors for useful guide.
-        //
-        // Basic ideas:
-        // (a) <param> tags *must* have a type, and *may* have a name
-        // (b) Tags without names are spacers and should be skipped
-        // (c) Tags with names are valid parameters; however, the names are NOT used and
-        //     their semantics are actually determined by their usage later on
-        //
-        // My algorithm:
-        //   - currentIndex counts how many <params> we have seen
-        //   - nParamsFound tracks the number of *named* (i.e. valid) params we've seen
-        //   - a <param> is considered to be valid if it has a name, a type, and its name
-        //     is at least 1 char long
-        //   - We only look for the first 3 valid <params> and store them in the (abc)Index
-        //     slot.
-
-        const char* name = attr["name"];
-        const char* type = attr["type"];
-
-        if (name && type && strlen(name) > 0) {
-          // Switch converts nParamsFound (0,1,2) into a, b or c
-          switch (currentAccessor_.nParamsFound) {
-          case 0:
-            currentAccessor_.data.aIndex = currentAccessor_.currentIndex;
-            break;
-          case 1:
-            currentAccessor_.data.bIndex = currentAccessor_.currentIndex;
-            break;
-          case 2:
-            currentAccessor_.data.cIndex = currentAccessor_.currentIndex;
-            break;
-          }
+      if (currentSource_.floats.size() > 0 && Bind(sourceBindings_, currentSource_.id, currentMesh_.sources.size())) {
+        collada::Source source;
+        source.id = currentSource_.id;
+        source.data = move(currentSource_.floats);
+        currentMesh_.sources.push_back(move(source));
+      }
+    }
+    ResetSourceAccumulator();
+  }
 
-          currentAccessor_.nParamsFound++;
-        }
-        currentAccessor_.currentIndex++;
-      })
-    );
+  // Listener 3+4+5:
+  //    /COLLADA/library_geometries/geometry/mesh/source
+  //    /COLLADA/library_geometries/geometry/mesh/source/technique_common/accessor
+  //    /COLLADA/library_geometries/geometry/mesh/source/technique_common/accessor/param
+  //
+
+  void LibGeometriesBuilder::Opened(Source, const Path&, const Attributes& attr) {
+    const char* tmpId = attr[keys_.id];
+    if (tmpId && tmpId[0]) {
+      currentAccessor_.id = ids_.Intern(tmpId);
+    }
+  }
 
-    // Listener 6+7:
-    //    /COLLADA/library_geometries/geometry/mesh/vertices
-    //    /COLLADA/library_geometries/geometry/mesh/vertices/input
-    //
-    // I'm not quite sure what the point of the <vertices> tag is; but, it's there so
-    // we have to handle it.
+  void LibGeometriesBuilder::Closed(Source, const Path&) {
+    if (currentAccessor_.id != NO_ID && currentAccessor_.nParamsFound > 0
+      && Bind(accessorBindings_, currentAccessor_.id, currentMesh_.accessors.size())
+    ) {
+      currentAccessor_.data.id = currentAccessor_.id;
+      currentMesh_.accessors.push_back(currentAccessor_.data);
+    }
+    ResetAccessorAccumulator();
+  }
+
+  void LibGeometriesBuilder::Opened(Accessor, const Path&, const Attributes& attr) {
+    const char* source = attr[keys_.source];
+    const char* count = attr[keys_.count];
+    const char* stride = attr[keys_.stride];
+    const char* offset = attr[keys_.offset];
+
+    if (source) {
+      currentAccessor_.data.source = Bound(sourceBindings_, ids_.Find(source));
+    }
+
+    if (count) { currentAccessor_.data.count = strtoul(count, nullptr, 0); }
+    if (stride) { currentAccessor_.data.stride = strtoul(stride, nullptr, 0); }
+    if (offset) { currentAccessor_.data.offset = strtoul(offset, nullptr, 0); }
+  }
+
+  void LibGeometriesBuilder::Opened(Param, const Path&, const Attributes& attr) {
+    // Notes re: COLLADA accessors (the spec is quite complicated & several variants are possible)
+    // See https://www.khronos.org/collada/wiki/Using_accessors for useful guide.
     //
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/vertices", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-        const char* id = attr["id"];
-        if (id) {
-          currentMesh_.vertexLink.id = id;
-        }
-      })
-    );
-
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/vertices/input", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-        const char* semantic = attr["semantic"];
-        const char* source = attr["source"];
-        if (semantic && source && strcmp(semantic, "POSITION") == 0) {
-          currentMesh_.vertexLink.accessor = source;
-        }
-      })
-    );
-
-    // Listener 8+9+10+11:
-    //    /COLLADA/library_geometries/geometry/mesh/polylist
-    //    /COLLADA/library_geometries/geometry/mesh/polylist/input
-    //    /COLLADA/library_geometries/geometry/mesh/polylist/vcount
-    //    /COLLADA/library_geometries/geometry/mesh/polylist/p
+    // Basic ideas:
+    // (a) <param> tags *must* have a type, and *may* have a name
+    // (b) Tags without names are spacers and should be skipped
+    // (c) Tags with names are valid parameters; however, the names are NOT used and
+    //     their semantics are actually determined by their usage later on
     //
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/polylist", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-        const char* material = attr["material"];
-        if (material) {
-          currentVertexIndex_.data.material = material;
-        }
-      })
-      .Closed([this](const Path&) {
-        if (currentVertexIndex_.trianglesOnly && currentVertexIndex_.data.indices.size() > 0
-          && currentVertexIndex_.data.position.accessor.size() != 0
-        ) {
-          currentMesh_.parts.push_back(currentVertexIndex_.data);
-        }
-        ResetVertexIndexAccumulator();
-      })
-    );
-
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/polylist/input", Tag()
-      .Opened([this](const Path&, const Attributes& attr) {
-        const char* semantic = attr["semantic"];
-        const char* source = attr["source"];
-        const char* offset = attr["offset"];
-
-        size_t offsetInt = 0;
-        if (offset) { offsetInt = strtoul(offset, nullptr, 0); }
-
-        if (semantic && source) {
-          if (strcmp(semantic, "VERTEX") == 0) {
-            currentVertexIndex_.data.position.accessor = source;
-            currentVertexIndex_.data.position.offset = offsetInt;
-          }
-          else if (strcmp(semantic, "NORMAL") == 0) {
-            currentVertexIndex_.data.normals.accessor = source;
-            currentVertexIndex_.data.normals.offset = offsetInt;
-          }
-          else if (strcmp(semantic, "TEXCOORD") == 0) {
-            currentVertexIndex_.data.texCoords.accessor = source;
-            currentVertexIndex_.data.texCoords.offset = offsetInt;
-          }
-        }
-      })
-    );
-
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/polylist/vcount", Tag()
-      .Opened([this](const Path&, const Attributes&) {
-        currentVertexIndex_.vCountBuffer = stringstream();
-      })
-      .Text([this](const Path&, const string& s) {
-        currentVertexIndex_.vCountBuffer << s;
-      })
-        .Closed([this](const Path&) {
-        unsigned int i;
-
-        while (currentVertexIndex_.vCountBuffer >> i) {
-          if (i != 3) { currentVertexIndex_.trianglesOnly = false; }
-        }
-      })
-    );
-
-    src.ListenFor("/COLLADA/library_geometries/geometry/mesh/polylist/p", Tag()
-      .Opened([this](const Path&, const Attributes&) {
-        currentVertexIndex_.pBuffer = stringstream();
-      })
-      .Text([this](const Path&, const string& s) {
-        currentVertexIndex_.pBuffer << s;
-      })
-      .Closed([this](const Path&) {
-        VertexIndex::IndexList::value_type index;
-
-        while (currentVertexIndex_.pBuffer >> index) {
-          currentVertexIndex_.data.indices.push_back(index);
-        }
-      })
-    );
+    // My algorithm:
+    //   - currentIndex counts how many <params> we have seen
+    //   - nParamsFound tracks the number of *named* (i.e. valid) params we've seen
+    //   - a <param> is considered to be valid if it has a name, a type, and its name
+    //     is at least 1 char long
+    //   - We only look for the first 3 valid <params> and store them in the (abc)Index
+    //     slot.
+
+    const char* name = attr[keys_.name];
+    const char* type = attr[keys_.type];
+
+    if (name && type && strlen(name) > 0) {
+      // Switch converts nParamsFound (0,1,2) into a, b or c
+      switch (currentAccessor_.nParamsFound) {
+      case 0:
+        currentAccessor_.data.aIndex = currentAccessor_.currentIndex;
+        break;
+      case 1:
+        currentAccessor_.data.bIndex = currentAccessor_.currentIndex;
+        break;
+      case 2:
+        currentAccessor_.data.cIndex = currentAccessor_.currentIndex;
+        break;
+      }
+
+      currentAccessor_.nParamsFound++;
+    }
+    currentAccessor_.currentIndex++;
+  }
+
+  // Listener 6+7:
+  //    /COLLADA/library_geometries/geometry/mesh/vertices
+  //    /COLLADA/library_geometries/geometry/mesh/vertices/input
+  //
+  // I'm not quite sure what the point of the <vertices> tag is; but, it's there so
+  // we have to handle it.
+  //
+
+  void LibGeometriesBuilder::Opened(Vertices, const Path&, const Attributes& attr) {
+    const char* id = attr[keys_.id];
+    if (id) {
+      currentMesh_.vertexLink.id = ids_.Intern(id);
+    }
+  }
+
+  void LibGeometriesBuilder::Opened(VerticesInput, const Path&, const Attributes& attr) {
+    const char* semantic = attr[keys_.semantic];
+    const char* source = attr[keys_.source];
+    if (semantic && source && strcmp(semantic, "POSITION") == 0) {
+      currentMesh_.vertexLink.accessor = Bound(accessorBindings_, ids_.Find(source));
+    }
+  }
+
+  // Listener 8+9+10+11:
+  //    /COLLADA/library_geometries/geometry/mesh/polylist
+  //    /COLLADA/library_geometries/geometry/mesh/polylist/input
+  //    /COLLADA/library_geometries/geometry/mesh/polylist/vcount
+  //    /COLLADA/library_geometries/geometry/mesh/polylist/p
+  //
+
+  void LibGeometriesBuilder::Opened(Polylist, const Path&, const Attributes& attr) {
+    OpenPart(attr);
+  }
+
+  void LibGeometriesBuilder::Closed(Polylist, const Path&) {
+    ClosePart();
+  }
+
+  void LibGeometriesBuilder::Opened(PolylistInput, const Path&, const Attributes& attr) {
+    OpenInput(attr);
+  }
+
+  void LibGeometriesBuilder::Opened(VCount, const Path&, const Attributes&) {
+    numericText_.Clear();
+    currentPayload_ = PayloadText();
+  }
+
+  void LibGeometriesBuilder::Chunk(VCount, const Path&, StringView s) {
+    if (deferred_) {
+      currentPayload_.Append(s);
+    }
+    else {
+      numericText_.Append(s.data(), s.data() + s.size(), VCountTo{ currentVertexIndex_.counts });
+    }
+  }
+
+  void LibGeometriesBuilder::Closed(VCount, const Path&) {
+    if (deferred_) {
+      Defer(DeferredPayload::VCOUNT, 0, currentVertexIndex_.polygons);
+      return;
+    }
+
+    numericText_.Finish(VCountTo{ currentVertexIndex_.counts });
+  }
+
+  void LibGeometriesBuilder::Opened(P, const Path&, const Attributes&) {
+    numericText_.Clear();
+    currentPayload_ = PayloadText();
+
+    if (deferred_) {
+      return;
+    }
+
+    VertexIndex& part = currentVertexIndex_.data;
+    Presize(part.indices, ExpectedIndices());
+
+    if (!currentVertexIndex_.counts.TrianglesOnly()) {
+      // Sources come before the polylists that use them, so positions are decoded by now
+      currentVertexIndex_.hasPositions = ResolveInput(currentMesh_.sources, currentMesh_.accessors,
+        part.position, 3, currentVertexIndex_.positions);
+      currentVertexIndex_.triangulator.Begin(currentVertexIndex_.counts, part.stride,
+        currentVertexIndex_.hasPositions ? &currentVertexIndex_.positions : nullptr, part.indices);
+    }
+  }
+
+  void LibGeometriesBuilder::Chunk(P, const Path&, StringView s) {
+    if (deferred_) {
+      currentPayload_.Append(s);
+    }
+    else if (currentVertexIndex_.counts.TrianglesOnly()) {
+      numericText_.Append(s.data(), s.data() + s.size(), IndicesTo{ currentVertexIndex_.data.indices });
+    }
+    else {
+      numericText_.Append(s.data(), s.data() + s.size(), PolygonsTo{ currentVertexIndex_.triangulator });
+    }
+  }
+
+  void LibGeometriesBuilder::Closed(P, const Path&) {
+    if (deferred_) {
+      Defer(DeferredPayload::INDICES, 0, ExpectedIndices());
+      return;
+    }
+
+    if (currentVertexIndex_.counts.TrianglesOnly()) {
+      numericText_.Finish(IndicesTo{ currentVertexIndex_.data.indices });
+    }
+    else {
+      numericText_.Finish(PolygonsTo{ currentVertexIndex_.triangulator });
+    }
+  }
+
+  // Listeners 12 to 24:
+  //    /COLLADA/library_geometries/geometry/mesh/triangles
+  //    /COLLADA/library_geometries/geometry/mesh/polygons
+  //    /COLLADA/library_geometries/geometry/mesh/tristrips
+  //    /COLLADA/library_geometries/geometry/mesh/trifans
+  // and their inputs and <p>s
+  //
+
+  void LibGeometriesBuilder::Opened(Triangles, const Path&, const Attributes& attr) {
+    OpenPart(attr);
+  }
+
+  void LibGeometriesBuilder::Closed(Triangles, const Path&) {
+    ClosePart();
+  }
+
+  void LibGeometriesBuilder::Opened(TrianglesInput, const Path&, const Attributes& attr) {
+    OpenInput(attr);
+  }
+
+  void LibGeometriesBuilder::Opened(TrianglesP, const Path& path, const Attributes& attr) {
+    Opened(P(), path, attr);
+  }
+
+  void LibGeometriesBuilder::Chunk(TrianglesP, const Path& path, StringView s) {
+    Chunk(P(), path, s);
+  }
+
+  void LibGeometriesBuilder::Closed(TrianglesP, const Path& path) {
+    Closed(P(), path);
+  }
+
+  void LibGeometriesBuilder::Opened(Polygons, const Path&, const Attributes& attr) {
+    OpenPart(attr);
+  }
+
+  void LibGeometriesBuilder::Closed(Polygons, const Path&) {
+    ClosePart();
+  }
+
+  void LibGeometriesBuilder::Opened(PolygonsInput, const Path&, const Attributes& attr) {
+    OpenInput(attr);
+  }
+
+  void LibGeometriesBuilder::Opened(PolygonsP, const Path&, const Attributes&) {
+    OpenPrimitive();
+  }
+
+  void LibGeometriesBuilder::Chunk(PolygonsP, const Path&, StringView s) {
+    ChunkPrimitive(s);
+  }
+
+  void LibGeometriesBuilder::Closed(PolygonsP, const Path&) {
+    ClosePrimitive(POLYGON);
+  }
+
+  void LibGeometriesBuilder::Opened(PolygonsHoledP, const Path&, const Attributes&) {
+    OpenPrimitive();
+  }
+
+  void LibGeometriesBuilder::Chunk(PolygonsHoledP, const Path&, StringView s) {
+    ChunkPrimitive(s);
+  }
+
+  void LibGeometriesBuilder::Closed(PolygonsHoledP, const Path&) {
+    ClosePrimitive(POLYGON);
+  }
+
+  void LibGeometriesBuilder::Opened(TriStrips, const Path&, const Attributes& attr) {
+    OpenPart(attr);
+    if (keepStrips_) {
+      currentVertexIndex_.data.topology = VertexIndex::TRIANGLE_STRIP;
+    }
+  }
+
+  void LibGeometriesBuilder::Closed(TriStrips, const Path&) {
+    ClosePart();
+  }
+
+  void LibGeometriesBuilder::Opened(TriStripsInput, const Path&, const Attributes& attr) {
+    OpenInput(attr);
+  }
+
+  void LibGeometriesBuilder::Opened(TriStripsP, const Path&, const Attributes&) {
+    OpenPrimitive();
+  }
+
+  void LibGeometriesBuilder::Chunk(TriStripsP, const Path&, StringView s) {
+    ChunkPrimitive(s);
+  }
+
+  void LibGeometriesBuilder::Closed(TriStripsP, const Path&) {
+    ClosePrimitive(STRIP);
+  }
+
+  void LibGeometriesBuilder::Opened(TriFans, const Path&, const Attributes& attr) {
+    OpenPart(attr);
+  }
+
+  void LibGeometriesBuilder::Closed(TriFans, const Path&) {
+    ClosePart();
+  }
+
+  void LibGeometriesBuilder::Opened(TriFansInput, const Path&, const Attributes& attr) {
+    OpenInput(attr);
+  }
+
+  void LibGeometriesBuilder::Opened(TriFansP, const Path&, const Attributes&) {
+    OpenPrimitive();
+  }
+
+  void LibGeometriesBuilder::Chunk(TriFansP, const Path&, StringView s) {
+    ChunkPrimitive(s);
+  }
+
+  void LibGeometriesBuilder::Closed(TriFansP, const Path&) {
+    ClosePrimitive(FAN);
+  }
+
+  //
+  // Parts
+  //
+
+  void LibGeometriesBuilder::OpenPart(const Attributes& attr) {
+    const char* material = attr[keys_.material];
+    if (material) {
+      currentVertexIndex_.data.material = material;
+    }
+
+    const char* count = attr[keys_.count];
+    if (count) {
+      currentVertexIndex_.polygons = strtoul(count, nullptr, 0);
+    }
+  }
+
+  void LibGeometriesBuilder::ClosePart() {
+    if (deferred_) {
+      currentMesh_.parts.push_back(currentVertexIndex_.data);
+      currentMesh_.counts.push_back(move(currentVertexIndex_.counts));
+      ResetVertexIndexAccumulator();
+      return;
+    }
+
+    if (currentVertexIndex_.data.indices.size() > 0
+      && currentVertexIndex_.data.position.accessor != collada::Accessor::NOT_PRESENT
+    ) {
+      if (emitModel_) {
+        Emit(currentMesh_, currentVertexIndex_.data);
+      }
+      else {
+        BoundPart(currentMesh_.sources, currentMesh_.accessors, currentVertexIndex_.data);
+        currentMesh_.parts.push_back(move(currentVertexIndex_.data));
+      }
+    }
+    ResetVertexIndexAccumulator();
+  }
+
+  void LibGeometriesBuilder::OpenInput(const Attributes& attr) {
+    const char* semantic = attr[keys_.semantic];
+    const char* source = attr[keys_.source];
+    const char* offset = attr[keys_.offset];
+
+    size_t offsetInt = 0;
+    if (offset) { offsetInt = strtoul(offset, nullptr, 0); }
+
+    // Every input takes a slot in <p>, whether or not it's one we use
+    currentVertexIndex_.data.stride = max(currentVertexIndex_.data.stride, offsetInt + 1);
+
+    if (semantic && source) {
+      Id target = ids_.Find(source);
+
+      if (strcmp(semantic, "VERTEX") == 0) {
+        // Positions are reached through <vertices>
+        currentVertexIndex_.data.position.accessor = (target != NO_ID && target == currentMesh_.vertexLink.id)
+          ? currentMesh_.vertexLink.accessor : Bound(accessorBindings_, target);
+        currentVertexIndex_.data.position.offset = offsetInt;
+      }
+      else if (strcmp(semantic, "NORMAL") == 0) {
+        currentVertexIndex_.data.normals.accessor = Bound(accessorBindings_, target);
+        currentVertexIndex_.data.normals.offset = offsetInt;
+      }
+      else if (strcmp(semantic, "TEXCOORD") == 0) {
+        currentVertexIndex_.data.texCoords.accessor = Bound(accessorBindings_, target);
+        currentVertexIndex_.data.texCoords.offset = offsetInt;
+      }
+    }
+  }
+
+  void LibGeometriesBuilder::OpenPrimitive() {
+    numericText_.Clear();
+    currentVertexIndex_.primitive.clear();
+  }
+
+  void LibGeometriesBuilder::ChunkPrimitive(StringView s) {
+    numericText_.Append(s.data(), s.data() + s.size(), IndicesTo{ currentVertexIndex_.primitive });
+  }
+
+  void LibGeometriesBuilder::ClosePrimitive(Primitive primitive) {
+    const VertexIndex::IndexList& corners = currentVertexIndex_.primitive;
+    VertexIndex& part = currentVertexIndex_.data;
+    numericText_.Finish(IndicesTo{ currentVertexIndex_.primitive });
+
+    switch (primitive) {
+    case POLYGON:
+      if (deferred_) {
+        // Triangulated with the polylists, once the positions are decoded
+        const size_t stride = max(part.stride, (size_t)1);
+        const size_t n = corners.size() / stride;
+        part.indices.insert(part.indices.end(), corners.begin(), corners.begin() + n * stride);
+        currentVertexIndex_.counts.Add((unsigned int)n);
+      }
+      else {
+        currentVertexIndex_.hasPositions = ResolveInput(currentMesh_.sources, currentMesh_.accessors,
+          part.position, 3, currentVertexIndex_.positions);
+        currentVertexIndex_.triangulator.Begin(part.stride,
+          currentVertexIndex_.hasPositions ? &currentVertexIndex_.positions : nullptr, part.indices);
+        currentVertexIndex_.triangulator.AddPolygon(corners);
+      }
+      break;
+
+    case STRIP:
+      if (part.topology == VertexIndex::TRIANGLE_STRIP) {
+        AppendStrip(corners, part.stride, part.indices);
+      }
+      else {
+        WriteStrip(corners, part.stride, part.indices);
+      }
+      break;
+
+    case FAN:
+      WriteFan(corners, part.stride, part.indices);
+      break;
+    }
+  }
+
+  size_t LibGeometriesBuilder::ExpectedIndices() const {
+    // <vcount> comes before <p>, and gives the exact number of triangles where it's
+    // been decoded; otherwise guess that the polygons are triangles
+    size_t triangles = currentVertexIndex_.counts.triangles > 0
+      ? currentVertexIndex_.counts.triangles : currentVertexIndex_.polygons;
+    return triangles * 3 * max(currentVertexIndex_.data.stride, (size_t)1);
   }
 
   void LibGeometriesBuilder::ResetAccumulators() {
@@ -268,28 +630,381 @@ namespace collada {
   }
 
   void LibGeometriesBuilder::ResetMeshAccumulator() {
+    // Bindings made so far belong to the last <geometry>
+    geometry_++;
+
     currentMesh_.id.clear();
     currentMesh_.sources.clear();
     currentMesh_.accessors.clear();
     currentMesh_.parts.clear();
+    currentMesh_.counts.clear();
     currentMesh_.vertexLink = VertexLink();
   }
 
   void LibGeometriesBuilder::ResetSourceAccumulator() {
-    currentSource_.id.clear();
-    currentSource_.buffer = stringstream();
+    currentSource_.id = NO_ID;
+    currentSource_.count = 0;
+    currentSource_.floats.clear();
+    currentPayload_ = PayloadText();
   }
 
   void LibGeometriesBuilder::ResetAccessorAccumulator() {
-    currentAccessor_.id.clear();
+    currentAccessor_.id = NO_ID;
     currentAccessor_.nParamsFound = 0;
     currentAccessor_.currentIndex = 0;
-    currentAccessor_.data = Accessor();
+    currentAccessor_.data = collada::Accessor();
   }
 
   void LibGeometriesBuilder::ResetVertexIndexAccumulator() {
+    // The index storage is kept for the next <polylist>
+    VertexIndex::IndexList indices(move(currentVertexIndex_.data.indices));
+    indices.clear();
+
     currentVertexIndex_.data = VertexIndex();
-    currentVertexIndex_.trianglesOnly = true;
+    currentVertexIndex_.data.indices = move(indices);
+    currentVertexIndex_.polygons = 0;
+    currentVertexIndex_.counts = PolygonCounts();
+    currentVertexIndex_.primitive.clear();
+    currentVertexIndex_.hasPositions = false;
+  }
+
+  //
+  // Resolving references
+  //
+
+  bool LibGeometriesBuilder::Bind(vector<Binding>& bindings, Id id, size_t index) {
+    if (bindings.size() <= id) {
+      bindings.resize(ids_.Size());
+    }
+
+    Binding& binding = bindings[id];
+    if (binding.geometry == geometry_) {
+      return false;
+    }
+
+    binding.geometry = geometry_;
+    binding.index = index;
+    return true;
+  }
+
+  size_t LibGeometriesBuilder::Bound(const vector<Binding>& bindings, Id id) const {
+    if (id == NO_ID || id >= bindings.size() || bindings[id].geometry != geometry_) {
+      return collada::Accessor::NOT_PRESENT;
+    }
+    return bindings[id].index;
+  }
+
+  //
+  // Deferred decoding
+  //
+
+  void LibGeometriesBuilder::PayloadText::Append(StringView chunk) {
+    if (!copy.empty()) {
+      copy.append(chunk.data(), chunk.size());
+    }
+    else if (size == 0) {
+      data = chunk.data();
+      size = chunk.size();
+    }
+    else if (data + size == chunk.data()) {
+      size += chunk.size();
+    }
+    else {
+      copy.reserve(size + chunk.size());
+      copy.assign(data, size);
+      copy.append(chunk.data(), chunk.size());
+    }
+  }
+
+  void LibGeometriesBuilder::Defer(DeferredPayload::Kind kind, size_t source, size_t count) {
+    DeferredPayload payload;
+    payload.kind = kind;
+    payload.geometry = deferredGeometries_.size();
+    payload.part = currentMesh_.parts.size();
+    payload.source = source;
+    payload.count = count;
+    payload.text = move(currentPayload_);
+
+    deferredPayloads_.push_back(move(payload));
+    currentPayload_ = PayloadText();
+  }
+
+  void LibGeometriesBuilder::DecodeDeferred(unsigned int threads) {
+    // Each payload is decoded in one or more pieces; a piece's results go into the
+    // piece, and are joined into the meshes in document order afterwards, exactly as
+    // the same text would have been decoded during the parse.
+    struct Piece {
+      size_t payload;
+      const char* begin;
+      const char* end;
+      bool complete;
+      FloatSource floats;
+      VertexIndex::IndexList indices;
+      PolygonCounts counts;
+    };
+
+    vector<Piece> pieces;
+    vector<const char*> splits;
+
+    for (size_t i = 0; i < deferredPayloads_.size(); i++) {
+      const PayloadText& text = deferredPayloads_[i].text;
+
+      splits.clear();
+      SplitNumericText(text.Begin(), text.End(), DECODE_PIECE_SIZE, splits);
+      splits.push_back(text.End());
+
+      const char* begin = text.Begin();
+      for (const char* end : splits) {
+        Piece piece;
+        piece.payload = i;
+        piece.begin = begin;
+        piece.end = end;
+        piece.complete = true;
+
+        // Filled on other threads, so kept out of the arena
+        piece.floats = FloatSource(FloatSource::allocator_type(nullptr));
+        piece.indices = VertexIndex::IndexList(VertexIndex::IndexList::allocator_type(nullptr));
+        piece.counts.rest = VertexIndex::IndexList(VertexIndex::IndexList::allocator_type(nullptr));
+        pieces.push_back(move(piece));
+
+        begin = end;
+      }
+    }
+
+    // Biggest first, for an even load
+    vector<size_t> order(pieces.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&pieces](size_t a, size_t b) {
+      return pieces[a].end - pieces[a].begin > pieces[b].end - pieces[b].begin;
+    });
+
+    ParallelFor(order.size(), threads, [this, &pieces, &order](size_t i) {
+      Piece& piece = pieces[order[i]];
+
+      const DeferredPayload& payload = deferredPayloads_[piece.payload];
+
+      // The piece's share of the payload's expected count
+      size_t count = 0;
+      if (payload.count > 0) {
+        double share = (double)(piece.end - piece.begin) / (double)(payload.text.End() - payload.text.Begin());
+        count = ExpectedCount((size_t)(payload.count * share) + 1, piece.begin, piece.end);
+      }
+      switch (payload.kind) {
+      case DeferredPayload::FLOATS:
+        piece.floats.reserve(count);
+        piece.complete = DecodeFloats(piece.begin, piece.end, piece.floats);
+        break;
+      case DeferredPayload::INDICES:
+        piece.indices.reserve(count);
+        piece.complete = DecodeIndices(piece.begin, piece.end, piece.indices);
+        break;
+      case DeferredPayload::VCOUNT:
+        piece.complete = DecodeVCount(piece.begin, piece.end, piece.counts);
+        break;
+      }
+    });
+
+    // Join. Decoding a payload stops at its first bad token, so pieces after an
+    // incomplete one are ignored.
+    size_t first = 0;
+    while (first < pieces.size()) {
+      const DeferredPayload& payload = deferredPayloads_[pieces[first].payload];
+      DeferredGeometry& geometry = deferredGeometries_[payload.geometry];
+
+      size_t last = first;
+      bool complete = true;
+      FloatSource floats;
+
+      size_t floatCount = 0;
+      size_t indexCount = 0;
+      for (size_t i = first; i < pieces.size() && pieces[i].payload == pieces[first].payload; i++) {
+        floatCount += pieces[i].floats.size();
+        indexCount += pieces[i].indices.size();
+      }
+
+      for (; last < pieces.size() && pieces[last].payload == pieces[first].payload; last++) {
+        Piece& piece = pieces[last];
+        if (!complete) {
+          continue;
+        }
+
+        switch (payload.kind) {
+        case DeferredPayload::FLOATS:
+          if (floats.empty()) {
+            floats = move(piece.floats);
+            floats.reserve(floatCount);
+          }
+          else {
+            floats.insert(floats.end(), piece.floats.begin(), piece.floats.end());
+          }
+          break;
+        case DeferredPayload::INDICES: {
+          VertexIndex::IndexList& indices = geometry.mesh.parts[payload.part].indices;
+          if (indices.empty()) {
+            indices = move(piece.indices);
+            indices.reserve(indexCount);
+          }
+          else {
+            indices.insert(indices.end(), piece.indices.begin(), piece.indices.end());
+          }
+          break;
+        }
+        case DeferredPayload::VCOUNT:
+          geometry.mesh.counts[payload.part].Append(piece.counts);
+          break;
+        }
+
+        complete = piece.complete;
+      }
+
+      if (payload.kind == DeferredPayload::FLOATS) {
+        geometry.mesh.sources[payload.source].data = move(floats);
+      }
+
+      first = last;
+    }
+
+    // Triangulate the parts that need it, now that their positions are decoded
+    struct Triangulation {
+      MeshData* mesh;
+      size_t part;
+      const PolygonCounts* counts;
+      VertexIndex::IndexList triangles;
+    };
+
+    vector<Triangulation> triangulations;
+    for (DeferredGeometry& geometry : deferredGeometries_) {
+      for (size_t i = 0; i < geometry.mesh.parts.size(); i++) {
+        if (!geometry.mesh.counts[i].TrianglesOnly()) {
+          Triangulation triangulation;
+          triangulation.mesh = &geometry.mesh;
+          triangulation.part = i;
+          triangulation.counts = &geometry.mesh.counts[i];
+          triangulation.triangles = VertexIndex::IndexList(VertexIndex::IndexList::allocator_type(nullptr));
+          triangulations.push_back(move(triangulation));
+        }
+      }
+    }
+
+    ParallelFor(triangulations.size(), threads, [&triangulations](size_t i) {
+      Triangulation& triangulation = triangulations[i];
+      const VertexIndex& part = triangulation.mesh->parts[triangulation.part];
+
+      ResolvedInput positions;
+      bool hasPositions = ResolveInput(triangulation.mesh->sources, triangulation.mesh->accessors, part.position, 3, positions);
+      Triangulate(part.indices, *triangulation.counts, part.stride, hasPositions ? &positions : nullptr, triangulation.triangles);
+    });
+
+    for (Triangulation& triangulation : triangulations) {
+      triangulation.mesh->parts[triangulation.part].indices = move(triangulation.triangles);
+    }
+
+    // Parts kept for Meshes() are bounded here; emitted ones are as they're written
+    if (!emitModel_) {
+      std::vector<pair<MeshData*, VertexIndex*>> bounded;
+      for (DeferredGeometry& geometry : deferredGeometries_) {
+        for (VertexIndex& part : geometry.mesh.parts) {
+          bounded.push_back(make_pair(&geometry.mesh, &part));
+        }
+      }
+
+      ParallelFor(bounded.size(), threads, [&bounded](size_t i) {
+        const MeshData& mesh = *bounded[i].first;
+        BoundPart(mesh.sources, mesh.accessors, *bounded[i].second);
+      });
+    }
+
+    // The checks made at </polylist> and </geometry> when decoding during the parse
+    for (DeferredGeometry& geometry : deferredGeometries_) {
+      MeshData& mesh = geometry.mesh;
+
+      Mesh::VertexIndexList parts;
+      for (size_t i = 0; i < mesh.parts.size(); i++) {
+        if (mesh.parts[i].indices.size() > 0
+          && mesh.parts[i].position.accessor != collada::Accessor::NOT_PRESENT
+        ) {
+          parts.push_back(move(mesh.parts[i]));
+        }
+      }
+
+      if (emitModel_) {
+        for (const VertexIndex& part : parts) {
+          Emit(mesh, part);
+        }
+      }
+      else if (mesh.id.size() > 0 && parts.size() > 0) {
+        meshes_.insert(make_pair(
+          mesh.id,
+          Mesh(move(mesh.sources), move(mesh.accessors), move(mesh.vertexLink), move(parts))
+        ));
+      }
+    }
+
+    deferredPayloads_.clear();
+    deferredGeometries_.clear();
+  }
+
+  //
+  // Emitting a Model3d
+  //
+
+  void LibGeometriesBuilder::Emit(const MeshData& mesh, const VertexIndex& part) {
+    // As with Meshes(), geometries without IDs are left out
+    if (mesh.id.empty()) {
+      return;
+    }
+
+    Mesh3dBuffer buffer;
+    if (!WriteMesh3d(mesh.sources, mesh.accessors, part, buffer)) {
+      return;
+    }
+
+    buffer.id.assign(mesh.id.begin(), mesh.id.end());
+    buffer.material = Mesh3dBuffer::NO_MATERIAL;
+
+    if (part.material.size() > 0) {
+      map<string, size_t>::iterator found = materialIndices_.find(part.material);
+      if (found == materialIndices_.end()) {
+        materialNames_.push_back(std::string(part.material.begin(), part.material.end()));
+        found = materialIndices_.insert(make_pair(part.material, materialNames_.size() - 1)).first;
+      }
+      buffer.material = found->second;
+    }
+
+    meshBuffers_.push_back(move(buffer));
+  }
+
+  void LibGeometriesBuilder::OptimizeMeshes(unsigned int threads, MeshOptimizationReport* report) {
+    std::vector<MeshOptimizationReport> reports(meshBuffers_.size());
+
+    ParallelFor(meshBuffers_.size(), threads, [this, &reports](size_t i) {
+      reports[i] = OptimizeMesh(meshBuffers_[i]);
+    });
+
+    if (report) {
+      for (const MeshOptimizationReport& r : reports) {
+        report->before += r.before;
+        report->after += r.after;
+      }
+    }
+  }
+
+  void LibGeometriesBuilder::BuildMeshlets(unsigned int threads, unsigned int maxVertices,
+    unsigned int maxTriangles
+  ) {
+    ParallelFor(meshBuffers_.size(), threads, [this, maxVertices, maxTriangles](size_t i) {
+      james::BuildMeshlets(meshBuffers_[i], maxVertices, maxTriangles);
+    });
+  }
+
+  Model3d LibGeometriesBuilder::TakeModel(const VertexEncoding& encoding) {
+    Model3d model(materialNames_, move(meshBuffers_), encoding);
+
+    materialNames_.clear();
+    materialIndices_.clear();
+    meshBuffers_.clear();
+
+    return model;
   }
 
 } // namespace collada
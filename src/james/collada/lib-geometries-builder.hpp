@@ -1,51 +1,292 @@
 #pragma once
 
-#include <james/expat-facade.hpp>
+#include <james/expat-static-facade.hpp>
 #include "dom.hpp"
-#include <sstream>
+#include "id-table.hpp"
+#include "numeric-text.hpp"
+#include "triangulate.hpp"
+#include "../model-3d.hpp"
+#include "../optimize-mesh.hpp"
 
 namespace james {
 namespace collada {
 
-  using std::stringstream;
-
   struct LibGeometriesBuilder {
     typedef map<string, Mesh> MeshMap;
 
-    LibGeometriesBuilder(ExpatFacade&);
+    LibGeometriesBuilder();
 
     const MeshMap& Meshes() const { return meshes_; }
 
+    // The ids of the <source>s and <vertices> in Meshes()
+    const IdTable& Ids() const { return ids_; }
+
+    // With DeferDecoding called before the parse, the text of <float_array>, <p> and
+    // <vcount> is only located while parsing; DecodeDeferred then decodes it on several
+    // threads (0 meaning one per core) and completes Meshes(). The parser's input must
+    // stay in place until then, as with SimdXmlParser reading a document in memory.
+    void DeferDecoding();
+    void DecodeDeferred(unsigned int threads);
+
+    // With KeepStrips called before the parse, <tristrips> are kept as strips, joined by
+    // restarts (see VertexIndex::TRIANGLE_STRIP), rather than written as triangles
+    void KeepStrips();
+
+    // With EmitModel called before the parse, each part of a mesh is written out as a
+    // Mesh3d as soon as it's complete (after DecodeDeferred, if decoding is deferred),
+    // instead of being kept in Meshes(); a <geometry>'s sources are only kept until it
+    // closes. TakeModel then returns what was written, with its vertices encoded as
+    // encoding says.
+    void EmitModel();
+    Model3d TakeModel(const VertexEncoding& encoding = VertexEncoding());
+
+    // Runs OptimizeMesh over what's been emitted so far, on several threads (0 meaning
+    // one per core), adding up the meshes' stats in report if it isn't null
+    void OptimizeMeshes(unsigned int threads, MeshOptimizationReport* report);
+
+    // Runs BuildMeshlets over what's been emitted so far, on several threads
+    void BuildMeshlets(unsigned int threads, unsigned int maxVertices, unsigned int maxTriangles);
+
+    // Listeners, for StaticFacade
+    struct Geometry { static const char* Path() { return "/COLLADA/library_geometries/geometry"; } };
+    struct FloatArray { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/source/float_array"; } };
+    struct Source { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/source"; } };
+    struct Accessor { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/source/technique_common/accessor"; } };
+    struct Param { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/source/technique_common/accessor/param"; } };
+    struct Vertices { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/vertices"; } };
+    struct VerticesInput { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/vertices/input"; } };
+    struct Polylist { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/polylist"; } };
+    struct PolylistInput { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/polylist/input"; } };
+    struct VCount { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/polylist/vcount"; } };
+    struct P { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/polylist/p"; } };
+    struct Triangles { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/triangles"; } };
+    struct TrianglesInput { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/triangles/input"; } };
+    struct TrianglesP { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/triangles/p"; } };
+    struct Polygons { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/polygons"; } };
+    struct PolygonsInput { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/polygons/input"; } };
+    struct PolygonsP { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/polygons/p"; } };
+    struct PolygonsHoledP { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/polygons/ph/p"; } };
+    struct TriStrips { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/tristrips"; } };
+    struct TriStripsInput { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/tristrips/input"; } };
+    struct TriStripsP { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/tristrips/p"; } };
+    struct TriFans { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/trifans"; } };
+    struct TriFansInput { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/trifans/input"; } };
+    struct TriFansP { static const char* Path() { return "/COLLADA/library_geometries/geometry/mesh/trifans/p"; } };
+
+    typedef ListenerList<
+      Geometry, FloatArray, Source, Accessor, Param, Vertices, VerticesInput,
+      Polylist, PolylistInput, VCount, P,
+      Triangles, TrianglesInput, TrianglesP,
+      Polygons, PolygonsInput, PolygonsP, PolygonsHoledP,
+      TriStrips, TriStripsInput, TriStripsP,
+      TriFans, TriFansInput, TriFansP
+    > Listeners;
+
+    void Opened(Geometry, const Path&, const Attributes&);
+    void Closed(Geometry, const Path&);
+
+    void Opened(FloatArray, const Path&, const Attributes&);
+    void Chunk(FloatArray, const Path&, StringView);
+    void Closed(FloatArray, const Path&);
+
+    void Opened(Source, const Path&, const Attributes&);
+    void Closed(Source, const Path&);
+
+    void Opened(Accessor, const Path&, const Attributes&);
+
+    void Opened(Param, const Path&, const Attributes&);
+
+    void Opened(Vertices, const Path&, const Attributes&);
+
+    void Opened(VerticesInput, const Path&, const Attributes&);
+
+    void Opened(Polylist, const Path&, const Attributes&);
+    void Closed(Polylist, const Path&);
+
+    void Opened(PolylistInput, const Path&, const Attributes&);
+
+    void Opened(VCount, const Path&, const Attributes&);
+    void Chunk(VCount, const Path&, StringView);
+    void Closed(VCount, const Path&);
+
+    void Opened(P, const Path&, const Attributes&);
+    void Chunk(P, const Path&, StringView);
+    void Closed(P, const Path&);
+
+    // <triangles> are read as a <polylist> without a <vcount>
+    void Opened(Triangles, const Path&, const Attributes&);
+    void Closed(Triangles, const Path&);
+    void Opened(TrianglesInput, const Path&, const Attributes&);
+    void Opened(TrianglesP, const Path&, const Attributes&);
+    void Chunk(TrianglesP, const Path&, StringView);
+    void Closed(TrianglesP, const Path&);
+
+    // Each <p> of a <polygons> is one polygon. The holes of those in a <ph> are filled.
+    void Opened(Polygons, const Path&, const Attributes&);
+    void Closed(Polygons, const Path&);
+    void Opened(PolygonsInput, const Path&, const Attributes&);
+    void Opened(PolygonsP, const Path&, const Attributes&);
+    void Chunk(PolygonsP, const Path&, StringView);
+    void Closed(PolygonsP, const Path&);
+    void Opened(PolygonsHoledP, const Path&, const Attributes&);
+    void Chunk(PolygonsHoledP, const Path&, StringView);
+    void Closed(PolygonsHoledP, const Path&);
+
+    // Each <p> of a <tristrips> or <trifans> is one strip or fan
+    void Opened(TriStrips, const Path&, const Attributes&);
+    void Closed(TriStrips, const Path&);
+    void Opened(TriStripsInput, const Path&, const Attributes&);
+    void Opened(TriStripsP, const Path&, const Attributes&);
+    void Chunk(TriStripsP, const Path&, StringView);
+    void Closed(TriStripsP, const Path&);
+
+    void Opened(TriFans, const Path&, const Attributes&);
+    void Closed(TriFans, const Path&);
+    void Opened(TriFansInput, const Path&, const Attributes&);
+    void Opened(TriFansP, const Path&, const Attributes&);
+    void Chunk(TriFansP, const Path&, StringView);
+    void Closed(TriFansP, const Path&);
+
   private:
-    struct {
+    // Attribute names read by the listeners; see AttributeKey
+    struct Keys {
+      AttributeKey id, source, count, stride, offset, name, type, semantic, material;
+
+      Keys();
+    } keys_;
+
+    struct MeshData {
       string id;
-      Mesh::SourceMap sources;
-      Mesh::AccessorMap accessors;
+      Mesh::SourceList sources;
+      Mesh::AccessorList accessors;
       VertexLink vertexLink;
       Mesh::VertexIndexList parts;
+      vector<PolygonCounts> counts;   // With deferred decoding, each part's
     } currentMesh_;
 
     struct {
-      string id;
-      stringstream buffer;
+      Id id;
+      size_t count;
+      FloatSource floats;
     } currentSource_;
 
     struct {
-      string id;
+      Id id;
       size_t nParamsFound;
       size_t currentIndex;
-      Accessor data;
+      collada::Accessor data;
     } currentAccessor_;
 
     struct {
-      bool trianglesOnly;
       VertexIndex data;
-      stringstream vCountBuffer;
-      stringstream pBuffer;
+      size_t polygons;        // The count attribute
+      PolygonCounts counts;   // From <vcount>
+
+      // Unless counts is triangles only, <p> is triangulated as it's decoded, telling
+      // the shape of polygons by positions if they could be resolved
+      PolygonTriangulator triangulator;
+      ResolvedInput positions;
+      bool hasPositions;
+
+      // The current <p> of a <polygons>, <tristrips> or <trifans>
+      VertexIndex::IndexList primitive;
     } currentVertexIndex_;
 
+    // The text of whichever of <float_array>, <vcount> and <p> is open, decoded as it
+    // arrives
+    NumericChunks numericText_;
+
     MeshMap meshes_;
 
+    // References between the elements of a <mesh> are resolved as they're read, to
+    // indices into the current mesh's sources and accessors. Ids belong to the
+    // document, so each binding records the <geometry> it was made in.
+    static const size_t NOT_BOUND = (size_t)-1;
+
+    struct Binding {
+      size_t geometry;   // Or NOT_BOUND
+      size_t index;
+
+      Binding() : geometry(NOT_BOUND), index(0) {}
+    };
+
+    IdTable ids_;
+    size_t geometry_;                   // Numbers the current <geometry>
+    vector<Binding> sourceBindings_;    // By Id
+    vector<Binding> accessorBindings_;  // By Id
+
+    // Binds id to index in the current mesh unless it's already bound there
+    bool Bind(vector<Binding>& bindings, Id id, size_t index);
+
+    // What id is bound to in the current mesh, or Accessor::NOT_PRESENT
+    size_t Bound(const vector<Binding>& bindings, Id id) const;
+
+    // Text located for deferred decoding: a range of the parser's input, or a copy if
+    // it arrived in pieces that aren't adjacent there
+    struct PayloadText {
+      const char* data;
+      size_t size;
+      string copy;
+
+      PayloadText() : data(nullptr), size(0) {}
+
+      void Append(StringView chunk);
+
+      const char* Begin() const { return copy.empty() ? data : copy.data(); }
+      const char* End() const { return copy.empty() ? data + size : copy.data() + copy.size(); }
+    };
+
+    struct DeferredPayload {
+      enum Kind { FLOATS, INDICES, VCOUNT };
+
+      Kind kind;
+      size_t geometry;   // Index into deferredGeometries_
+      size_t part;       // INDICES, VCOUNT: index into the geometry's parts
+      size_t source;     // FLOATS: index into the geometry's sources
+      size_t count;      // How many numbers the document says there are, or 0
+      PayloadText text;
+    };
+
+    // A <geometry> whose payloads are yet to be decoded. Its parts are triangulated
+    // once their <vcount>s, <p>s and positions are all decoded.
+    struct DeferredGeometry {
+      MeshData mesh;
+    };
+
+    bool deferred_;
+    PayloadText currentPayload_;
+    vector<DeferredPayload> deferredPayloads_;
+    vector<DeferredGeometry> deferredGeometries_;
+
+    void Defer(DeferredPayload::Kind kind, size_t source, size_t count);
+
+    // The model being emitted, packed into a Model3d by TakeModel. Unlike the rest of
+    // what's built while parsing, it isn't allocated from the arena.
+    bool emitModel_;
+    std::vector<std::string> materialNames_;
+    map<string, size_t> materialIndices_;   // Into materialNames_
+    std::vector<Mesh3dBuffer> meshBuffers_;
+
+    bool keepStrips_;
+
+    void Emit(const MeshData& mesh, const VertexIndex& part);
+
+    // What's common to every kind of part, and to their inputs
+    void OpenPart(const Attributes& attr);
+    void ClosePart();
+    void OpenInput(const Attributes& attr);
+
+    // The <p>s of <polygons>, <tristrips> and <trifans>, which are always decoded while
+    // parsing: they're usually short, and each ends a primitive
+    enum Primitive { POLYGON, STRIP, FAN };
+
+    void OpenPrimitive();
+    void ChunkPrimitive(StringView s);
+    void ClosePrimitive(Primitive primitive);
+
+    // How many indices to expect in the current <p>
+    size_t ExpectedIndices() const;
+
     void ResetAccumulators();
     void ResetMeshAccumulator();
     void ResetSourceAccumulator();
@@ -0,0 +1,433 @@
+#include "numeric-text.hpp"
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <locale>
+#include <streambuf>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define NUMERIC_TEXT_SSE2 1
+#  include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+#if defined(_MSC_VER) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#  define NUMERIC_TEXT_SWAR 1
+#endif
+
+namespace james {
+namespace collada {
+
+  namespace {
+
+    // Reads [begin, end) in place
+    struct MemoryBuffer
+      : std::streambuf
+    {
+      MemoryBuffer(const char* begin, const char* end) {
+        setg(const_cast<char*>(begin), const_cast<char*>(begin), const_cast<char*>(end));
+      }
+    };
+
+    inline bool IsDigit(char c) {
+      return (unsigned char)(c - '0') < 10;
+    }
+
+    inline unsigned int LowestBit(uint64_t mask) {
+#ifdef _MSC_VER
+      unsigned long i;
+      if (_BitScanForward(&i, (unsigned long)mask)) {
+        return (unsigned int)i;
+      }
+      _BitScanForward(&i, (unsigned long)(mask >> 32));
+      return (unsigned int)i + 32;
+#else
+      return (unsigned int)__builtin_ctzll(mask);
+#endif
+    }
+
+    // First non-space character in [p, end), or end. Runs of indentation and line breaks
+    // are passed over 16 bytes at a time.
+    inline const char* SkipSpace(const char* p, const char* end) {
+      if (p == end || !IsNumericSpace(*p)) {
+        return p;
+      }
+
+#ifdef NUMERIC_TEXT_SSE2
+      const __m128i space = _mm_set1_epi8(' ');
+      const __m128i belowTab = _mm_set1_epi8('\t' - 1);
+      const __m128i aboveReturn = _mm_set1_epi8('\r' + 1);
+
+      for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(block, space),
+          _mm_and_si128(_mm_cmpgt_epi8(block, belowTab), _mm_cmplt_epi8(block, aboveReturn)));
+
+        unsigned int mask = ~(unsigned int)_mm_movemask_epi8(spaces) & 0xffff;
+        if (mask) {
+          return p + LowestBit(mask);
+        }
+      }
+#endif
+      while (p < end && IsNumericSpace(*p)) {
+        p++;
+      }
+      return p;
+    }
+
+    const uint64_t POWERS_OF_10[] = {
+      1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull
+    };
+
+    // The value of the first n (1 to 8) characters of word, which are digits, as loaded
+    // from memory on a little-endian machine. Those past the digits are shifted out and
+    // replaced by leading zeros, and then pairs, quads and octets of digits are combined
+    // in parallel.
+    inline uint64_t LeadingDigits(uint64_t word, unsigned int n) {
+      uint64_t values = (word - 0x3030303030303030ull) << (8 * (8 - n));
+      values = (values * 10 + (values >> 8)) & 0x00ff00ff00ff00ffull;
+      values = (values * 100 + (values >> 16)) & 0x0000ffff0000ffffull;
+      return (values * 10000 + (values >> 32)) & 0x00000000ffffffffull;
+    }
+
+    // Digits accumulated into a mantissa; any more and it could overflow
+    const int MAX_MANTISSA_DIGITS = 19;
+
+    // Appends the run of digits at p to mantissa, eight at a time where the text allows,
+    // up to a total of MAX_MANTISSA_DIGITS. Returns the end of the digits consumed.
+    inline const char* AccumulateDigits(const char* p, const char* end, uint64_t& mantissa, int& digits) {
+#ifdef NUMERIC_TEXT_SWAR
+      while (end - p >= 8 && digits <= MAX_MANTISSA_DIGITS - 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+
+        // The top bit of each byte that isn't a digit. Borrows and carries only run
+        // towards later bytes, so the first flagged byte is the first non-digit.
+        uint64_t nonDigits = ((word + 0x4646464646464646ull) | (word - 0x3030303030303030ull)) & 0x8080808080808080ull;
+        unsigned int n = nonDigits ? LowestBit(nonDigits) / 8 : 8;
+        if (n == 0) {
+          return p;
+        }
+
+        mantissa = mantissa * POWERS_OF_10[n] + LeadingDigits(word, n);
+        digits += n;
+        p += n;
+
+        if (n < 8) {
+          return p;
+        }
+      }
+#endif
+      while (p < end && IsDigit(*p) && digits < MAX_MANTISSA_DIGITS) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        digits++;
+        p++;
+      }
+      return p;
+    }
+
+    const double EXACT_POWERS_OF_10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // Whether a normal double lies exactly halfway between two adjacent floats: its 29
+    // mantissa bits below float's precision are a one followed by zeros
+    inline bool IsFloatMidpoint(double value) {
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      return (bits & 0x1fffffffull) == 0x10000000ull;
+    }
+
+    // Decodes one number the slow way, for the forms the fast path doesn't cover
+    bool ParseFloatExactly(const char* begin, const char* end, float& out) {
+      MemoryBuffer buffer(begin, end);
+      std::istream src(&buffer);
+      src.imbue(std::locale::classic());
+
+      return (src >> out) && src.peek() == std::char_traits<char>::eof();
+    }
+
+    // Decodes the number in [p, end), which operator>> would have read as one float
+    // followed by whitespace. Returns the end of the number, or nullptr if the text
+    // there isn't one.
+    //
+    // Decimal forms with at most 19 digits and a small exponent - everything an
+    // exporter like Blender writes - are converted with a single double multiplication
+    // or division of exactly represented operands, which rounds correctly (and can't
+    // overflow a float). Rounding that double to float is correct too unless it fell
+    // exactly halfway between two floats: the number it was rounded from could have been
+    // on either side, so those are left to the standard library, as is anything else.
+    const char* ParseFloat(const char* p, const char* end, float& out) {
+      const char* start = p;
+
+      bool negative = false;
+      if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+      }
+
+      uint64_t mantissa = 0;
+      int digits = 0;
+      int exponent = 0;
+      bool exact = true;
+
+      const char* intStart = p;
+      p = AccumulateDigits(p, end, mantissa, digits);
+      if (p < end && IsDigit(*p)) {
+        exact = false;
+        while (p < end && IsDigit(*p)) { p++; }
+      }
+      bool anyDigits = p != intStart;
+
+      if (p < end && *p == '.') {
+        p++;
+
+        const char* fracStart = p;
+        p = AccumulateDigits(p, end, mantissa, digits);
+        exponent -= (int)(p - fracStart);
+        if (p < end && IsDigit(*p)) {
+          exact = false;
+          while (p < end && IsDigit(*p)) { p++; }
+        }
+        anyDigits = anyDigits || p != fracStart;
+      }
+
+      if (!anyDigits) {
+        return nullptr;
+      }
+
+      if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+          negativeExponent = *p == '-';
+          p++;
+        }
+
+        if (p == end || !IsDigit(*p)) {
+          return nullptr;
+        }
+
+        int e = 0;
+        for (; p < end && IsDigit(*p); p++) {
+          if (e < 100000) {
+            e = e * 10 + (*p - '0');
+          }
+        }
+        exponent += negativeExponent ? -e : e;
+      }
+
+      if (p < end && !IsNumericSpace(*p)) {
+        return nullptr;
+      }
+
+      if (exact && mantissa == 0) {
+        out = negative ? -0.0f : 0.0f;
+        return p;
+      }
+
+      if (exact && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        if (exponent < 0) {
+          value /= EXACT_POWERS_OF_10[-exponent];
+        }
+        else {
+          value *= EXACT_POWERS_OF_10[exponent];
+        }
+
+        if (!IsFloatMidpoint(value)) {
+          out = negative ? -(float)value : (float)value;
+          return p;
+        }
+      }
+
+      return ParseFloatExactly(start, p, out) ? p : nullptr;
+    }
+
+    // Decodes the unsigned integer in [p, end), which operator>> would have read as one
+    // followed by whitespace - including its acceptance of a sign, "-1" wrapping around.
+    // Returns the end of the number, or nullptr if the text there isn't one or it's too
+    // big.
+    const char* ParseUnsigned(const char* p, const char* end, unsigned int& out) {
+      bool negative = false;
+      if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+      }
+
+      const char* digitsStart = p;
+      while (p < end && *p == '0') {
+        p++;
+      }
+
+      uint64_t value = 0;
+      int digits = 0;
+      p = AccumulateDigits(p, end, value, digits);
+
+      // Digits left over mean more than MAX_MANTISSA_DIGITS, which is too many
+      if (p == digitsStart || (p < end && !IsNumericSpace(*p)) || value > UINT_MAX) {
+        return nullptr;
+      }
+
+      out = negative ? 0u - (unsigned int)value : (unsigned int)value;
+      return p;
+    }
+
+#ifdef NUMERIC_TEXT_SSE2
+    // Decodes numbers from p, 16 bytes at a time, for as long as the text is only digits
+    // and whitespace. Within a block the numbers' starts and ends are found from bit
+    // masks, and numbers of up to eight digits are converted without a loop. Returns
+    // where it stopped: at whitespace or the start of a number it left for ParseUnsigned.
+    template <typename Store>
+    const char* DecodeUnsignedBlocks(const char* p, const char* end, Store& store) {
+      const __m128i space = _mm_set1_epi8(' ');
+      const __m128i belowTab = _mm_set1_epi8('\t' - 1);
+      const __m128i aboveReturn = _mm_set1_epi8('\r' + 1);
+      const __m128i belowZero = _mm_set1_epi8('0' - 1);
+      const __m128i aboveNine = _mm_set1_epi8('9' + 1);
+
+      // The block, followed by zeros for the loads of numbers near its end
+      char local[24] = {};
+
+      while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+
+        unsigned int spaces = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, space),
+          _mm_and_si128(_mm_cmpgt_epi8(block, belowTab), _mm_cmplt_epi8(block, aboveReturn))));
+        unsigned int digits = (unsigned int)_mm_movemask_epi8(
+          _mm_and_si128(_mm_cmpgt_epi8(block, belowZero), _mm_cmplt_epi8(block, aboveNine)));
+
+        if ((spaces | digits) != 0xffff) {
+          return p;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(local), block);
+
+        // p is never in the middle of a number, so each run of digits starts one
+        unsigned int starts = digits & ~(digits << 1);
+        unsigned int consumed = 16;
+
+        while (starts) {
+          unsigned int start = LowestBit(starts);
+          unsigned int ends = spaces & (~0u << start);
+
+          // A number running into the next block, or one that's too long, is left for
+          // the next round
+          unsigned int length = ends ? LowestBit(ends) - start : 16;
+          if (length > 8) {
+            consumed = start;
+            break;
+          }
+
+          uint64_t word;
+          memcpy(&word, local + start, 8);
+          store((unsigned int)LeadingDigits(word, length));
+
+          starts &= starts - 1;
+        }
+
+        if (consumed == 0) {
+          return p;
+        }
+        p += consumed;
+      }
+
+      return p;
+    }
+#endif
+
+    template <typename Store>
+    bool DecodeUnsigned(const char* p, const char* end, Store store) {
+      for (;;) {
+#ifdef NUMERIC_TEXT_SSE2
+        p = DecodeUnsignedBlocks(p, end, store);
+#endif
+        p = SkipSpace(p, end);
+        if (p == end) {
+          return true;
+        }
+
+        unsigned int value;
+        p = ParseUnsigned(p, end, value);
+        if (!p) {
+          return false;
+        }
+
+        store(value);
+      }
+    }
+
+  }
+
+  bool DecodeFloats(const char* begin, const char* end, FloatSource& out) {
+    const char* p = SkipSpace(begin, end);
+
+    while (p < end) {
+      float f;
+      p = ParseFloat(p, end, f);
+      if (!p) {
+        return false;
+      }
+
+      out.push_back(f);
+      p = SkipSpace(p, end);
+    }
+
+    return true;
+  }
+
+  bool DecodesAnyFloat(const char* begin, const char* end) {
+    const char* p = SkipSpace(begin, end);
+    float f;
+    return p < end && ParseFloat(p, end, f) != nullptr;
+  }
+
+  bool DecodeIndices(const char* begin, const char* end, VertexIndex::IndexList& out) {
+    return DecodeUnsigned(begin, end, [&out](unsigned int i) {
+      out.push_back(i);
+    });
+  }
+
+  bool DecodePolygons(const char* begin, const char* end, PolygonTriangulator& out) {
+    return DecodeUnsigned(begin, end, [&out](unsigned int i) {
+      out.Add(i);
+    });
+  }
+
+  bool DecodeVCount(const char* begin, const char* end, PolygonCounts& out) {
+    return DecodeUnsigned(begin, end, [&out](unsigned int i) {
+      out.Add(i);
+    });
+  }
+
+  size_t ExpectedCount(size_t count, const char* begin, const char* end) {
+    // Each number takes at least a character and a separator
+    size_t most = (size_t)(end - begin) / 2 + 1;
+    return count < most ? count : most;
+  }
+
+  void SplitNumericText(const char* begin, const char* end, size_t pieceSize, vector<const char*>& splits) {
+    const char* p = begin;
+
+    while ((size_t)(end - p) > pieceSize) {
+      p += pieceSize;
+      while (p < end && !IsNumericSpace(*p)) {
+        p++;
+      }
+      if (p == end) {
+        break;
+      }
+
+      splits.push_back(p);
+    }
+  }
+
+} // namespace collada
+} // namespace james
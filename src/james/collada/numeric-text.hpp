@@ -0,0 +1,118 @@
+#pragma once
+
+#include "dom.hpp"
+#include "triangulate.hpp"
+
+namespace james {
+namespace collada {
+
+  // The characters that separate numbers: those operator>> skips in the classic locale
+  inline bool IsNumericSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+  }
+
+  // Decoders for the whitespace-separated numbers in <float_array>, <p> and <vcount>.
+  // They decode as repeated operator>> would: decoding stops at the first token that
+  // isn't a number, and false is returned if that happened before the end of the text.
+  //
+  // A text may be split at any whitespace and the pieces decoded separately.
+
+  // Gives the same floats as strtof in the C locale. A token must be a number in full,
+  // so "1.5x" stops decoding where operator>> would have taken 1.5 first.
+  bool DecodeFloats(const char* begin, const char* end, FloatSource& out);
+
+  // Whether DecodeFloats would give at least one float: whether the first token is one
+  bool DecodesAnyFloat(const char* begin, const char* end);
+
+  bool DecodeIndices(const char* begin, const char* end, VertexIndex::IndexList& out);
+
+  // Indices for a <polylist> with polygons other than triangles, triangulated as they're
+  // decoded
+  bool DecodePolygons(const char* begin, const char* end, PolygonTriangulator& out);
+
+  bool DecodeVCount(const char* begin, const char* end, PolygonCounts& out);
+
+  // Text that arrives in chunks, decoded as it arrives by one of the functions above
+  // (bound to its output, as decode(begin, end)). Only a number split between chunks is
+  // held back until the next, so the text as a whole is never stored; the storage for
+  // such a number is kept from one element to the next.
+  struct NumericChunks {
+    NumericChunks() : failed_(false) {}
+
+    template <typename Decode>
+    void Append(const char* begin, const char* end, Decode decode);
+
+    // Decodes the number held back at the end of the text, if there is one. Returns
+    // false if decoding stopped at a bad token.
+    template <typename Decode>
+    bool Finish(Decode decode);
+
+    // Ready for another element's text
+    void Clear() {
+      split_.clear();
+      failed_ = false;
+    }
+
+  private:
+    string split_;
+    bool failed_;
+  };
+
+  // How many numbers to reserve space for, given a count attribute from the document
+  // and the text that should hold that many: counts the text can't hold are capped.
+  size_t ExpectedCount(size_t count, const char* begin, const char* end);
+
+  // Where to split [begin, end) into pieces of about pieceSize bytes for decoding: the
+  // boundaries, excluding begin and end, are appended to splits. Pieces only end at
+  // whitespace.
+  void SplitNumericText(const char* begin, const char* end, size_t pieceSize, vector<const char*>& splits);
+
+  template <typename Decode>
+  void NumericChunks::Append(const char* begin, const char* end, Decode decode) {
+    if (failed_) {
+      return;
+    }
+
+    const char* p = begin;
+
+    // Complete the number split at the end of the last chunk
+    if (!split_.empty()) {
+      while (p < end && !IsNumericSpace(*p)) {
+        p++;
+      }
+      split_.append(begin, p);
+
+      if (p == end) {
+        return;
+      }
+      if (!decode(split_.data(), split_.data() + split_.size())) {
+        failed_ = true;
+        return;
+      }
+      split_.clear();
+    }
+
+    // This chunk's own last number may continue in the next
+    const char* last = end;
+    while (last > p && !IsNumericSpace(last[-1])) {
+      last--;
+    }
+
+    if (!decode(p, last)) {
+      failed_ = true;
+      return;
+    }
+    split_.assign(last, end);
+  }
+
+  template <typename Decode>
+  bool NumericChunks::Finish(Decode decode) {
+    if (!failed_ && !split_.empty()) {
+      failed_ = !decode(split_.data(), split_.data() + split_.size());
+      split_.clear();
+    }
+    return !failed_;
+  }
+
+} // namespace collada
+} // namespace james
@@ -0,0 +1,281 @@
+#include "triangulate.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace james {
+namespace collada {
+
+  namespace {
+
+    const size_t ALL = (size_t)-1;
+
+    // Twice the signed area of triangle abc, points being (u, v) pairs: positive if it
+    // turns left
+    float Turn(const float* a, const float* b, const float* c) {
+      return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+    }
+
+    bool SameCorner(const unsigned int* a, const unsigned int* b, size_t stride) {
+      return equal(a, a + stride, b);
+    }
+
+    bool InTriangle(const float* p, const float* a, const float* b, const float* c) {
+      return Turn(a, b, p) >= 0 && Turn(b, c, p) >= 0 && Turn(c, a, p) >= 0;
+    }
+
+  }
+
+  void PolygonCounts::Append(const PolygonCounts& next) {
+    if (rest.empty()) {
+      leadingTriangles += next.leadingTriangles;
+    }
+    else {
+      rest.insert(rest.end(), next.leadingTriangles, 3);
+    }
+    rest.insert(rest.end(), next.rest.begin(), next.rest.end());
+    triangles += next.triangles;
+  }
+
+  void PolygonTriangulator::Begin(const PolygonCounts& counts, size_t stride,
+    const ResolvedInput* positions, VertexIndex::IndexList& out
+  ) {
+    counts_ = &counts;
+    out_ = &out;
+    stride_ = max(stride, (size_t)1);
+    positions_ = positions;
+    next_ = 0;
+    corners_.clear();
+
+    direct_ = counts.TrianglesOnly() ? ALL : counts.leadingTriangles * 3 * stride_;
+    Advance();
+  }
+
+  void PolygonTriangulator::Begin(size_t stride, const ResolvedInput* positions, VertexIndex::IndexList& out) {
+    counts_ = nullptr;
+    out_ = &out;
+    stride_ = max(stride, (size_t)1);
+    positions_ = positions;
+    direct_ = 0;
+    next_ = 0;
+  }
+
+  void PolygonTriangulator::AddPolygon(const VertexIndex::IndexList& corners) {
+    const size_t n = corners.size() / stride_;
+    if (n < 3) {
+      return;
+    }
+
+    corners_.assign(corners.begin(), corners.begin() + n * stride_);
+    if (n == 3) {
+      out_->insert(out_->end(), corners_.begin(), corners_.end());
+    }
+    else {
+      WritePolygon(n);
+    }
+    corners_.clear();
+  }
+
+  void PolygonTriangulator::Advance() {
+    // Triangles that follow are passed through too, and empty polygons skipped
+    const VertexIndex::IndexList& rest = counts_->rest;
+    while (next_ < rest.size() && (rest[next_] == 3 || rest[next_] == 0)) {
+      direct_ += (rest[next_] == 3) ? 3 * stride_ : 0;
+      next_++;
+    }
+  }
+
+  void PolygonTriangulator::AddToPolygon(unsigned int index) {
+    if (next_ == counts_->rest.size()) {
+      return;
+    }
+
+    corners_.push_back(index);
+
+    size_t n = counts_->rest[next_];
+    if (corners_.size() == n * stride_) {
+      if (n > 3) {
+        WritePolygon(n);
+      }
+      corners_.clear();
+      next_++;
+      Advance();
+    }
+  }
+
+  void PolygonTriangulator::WritePolygon(size_t n) {
+    if (positions_ && EarClip(n)) {
+      return;
+    }
+
+    for (size_t i = 1; i + 1 < n; i++) {
+      WriteCorner(0);
+      WriteCorner(i);
+      WriteCorner(i + 1);
+    }
+  }
+
+  bool PolygonTriangulator::EarClip(size_t n) {
+    // Project the polygon onto the axis plane it most faces, by the normal from Newell's
+    // method, turned so that it runs anticlockwise there
+    points_.resize(n * 3);
+    for (size_t i = 0; i < n; i++) {
+      if (!positions_->Read(corners_[i * stride_ + positions_->indexOffset], &points_[i * 3])) {
+        return false;
+      }
+    }
+
+    float normal[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < n; i++) {
+      const float* a = &points_[i * 3];
+      const float* b = &points_[((i + 1) % n) * 3];
+      normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+      normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+      normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+    }
+
+    size_t axis = 0;
+    for (size_t c = 1; c < 3; c++) {
+      axis = (fabs(normal[c]) > fabs(normal[axis])) ? c : axis;
+    }
+    if (normal[axis] == 0) {
+      return false;
+    }
+
+    const size_t u = (axis + 1) % 3;
+    const size_t v = (axis + 2) % 3;
+    const float flip = (normal[axis] < 0) ? -1.0f : 1.0f;
+    for (size_t i = 0; i < n; i++) {
+      float pu = points_[i * 3 + u] * flip;
+      float pv = points_[i * 3 + v];
+      points_[i * 2] = pu;
+      points_[i * 2 + 1] = pv;
+    }
+
+    // A convex polygon is left to the fan
+    bool convex = true;
+    for (size_t i = 0; i < n && convex; i++) {
+      convex = Turn(&points_[((i + n - 1) % n) * 2], &points_[i * 2], &points_[((i + 1) % n) * 2]) >= 0;
+    }
+    if (convex) {
+      return false;
+    }
+
+    // The corners left, as a ring: links_[i] is the one before i, links_[n + i] the one after
+    links_.resize(n * 2);
+    for (size_t i = 0; i < n; i++) {
+      links_[i] = (unsigned int)((i + n - 1) % n);
+      links_[n + i] = (unsigned int)((i + 1) % n);
+    }
+
+    size_t left = n;
+    size_t i = 0;
+    size_t tried = 0;
+
+    while (left > 3 && tried < left) {
+      const size_t before = links_[i];
+      const size_t after = links_[n + i];
+      const float* a = &points_[before * 2];
+      const float* b = &points_[i * 2];
+      const float* c = &points_[after * 2];
+
+      bool ear = Turn(a, b, c) > 0;
+      for (size_t j = links_[n + after]; ear && j != before; j = links_[n + j]) {
+        ear = !InTriangle(&points_[j * 2], a, b, c);
+      }
+
+      if (!ear) {
+        i = after;
+        tried++;
+        continue;
+      }
+
+      WriteCorner(before);
+      WriteCorner(i);
+      WriteCorner(after);
+
+      links_[n + before] = (unsigned int)after;
+      links_[after] = (unsigned int)before;
+      left--;
+      i = before;
+      tried = 0;
+    }
+
+    // What's left is a triangle, or a ring that has no ears because it crosses itself;
+    // either is written as a fan
+    for (size_t j = links_[n + i]; links_[n + j] != i; j = links_[n + j]) {
+      WriteCorner(i);
+      WriteCorner(j);
+      WriteCorner(links_[n + j]);
+    }
+    return true;
+  }
+
+  void PolygonTriangulator::WriteCorner(size_t corner) {
+    const unsigned int* indices = &corners_[corner * stride_];
+    out_->insert(out_->end(), indices, indices + stride_);
+  }
+
+  void WriteStrip(const VertexIndex::IndexList& corners, size_t stride, VertexIndex::IndexList& out) {
+    stride = max(stride, (size_t)1);
+    const size_t n = corners.size() / stride;
+    const unsigned int* corner = corners.data();
+
+    for (size_t i = 0; i + 2 < n; i++) {
+      const unsigned int* a = corner + i * stride;
+      const unsigned int* b = a + stride;
+      const unsigned int* c = b + stride;
+      if (SameCorner(a, b, stride) || SameCorner(b, c, stride) || SameCorner(a, c, stride)) {
+        continue;
+      }
+
+      if (i % 2 == 1) {
+        swap(a, b);
+      }
+      out.insert(out.end(), a, a + stride);
+      out.insert(out.end(), b, b + stride);
+      out.insert(out.end(), c, c + stride);
+    }
+  }
+
+  void WriteFan(const VertexIndex::IndexList& corners, size_t stride, VertexIndex::IndexList& out) {
+    stride = max(stride, (size_t)1);
+    const size_t n = corners.size() / stride;
+    const unsigned int* a = corners.data();
+
+    for (size_t i = 1; i + 1 < n; i++) {
+      const unsigned int* b = a + i * stride;
+      out.insert(out.end(), a, a + stride);
+      out.insert(out.end(), b, b + 2 * stride);
+    }
+  }
+
+  void AppendStrip(const VertexIndex::IndexList& corners, size_t stride, VertexIndex::IndexList& out) {
+    stride = max(stride, (size_t)1);
+    const size_t n = corners.size() / stride;
+    if (n < 3) {
+      return;
+    }
+
+    if (!out.empty()) {
+      out.insert(out.end(), stride, RESTART_INDEX);
+    }
+    out.insert(out.end(), corners.begin(), corners.begin() + n * stride);
+  }
+
+  void Triangulate(const VertexIndex::IndexList& indices, const PolygonCounts& counts, size_t stride,
+    const ResolvedInput* positions, VertexIndex::IndexList& out
+  ) {
+    out.reserve(counts.TrianglesOnly() ? indices.size() : counts.triangles * 3 * max(stride, (size_t)1));
+
+    PolygonTriangulator triangulator;
+    triangulator.Begin(counts, stride, positions, out);
+    for (unsigned int index : indices) {
+      triangulator.Add(index);
+    }
+  }
+
+} // namespace collada
+} // namespace james
\ No newline at end of file
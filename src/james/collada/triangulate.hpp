@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include "dom.hpp"
+#include "write-mesh-3d.hpp"
+
+namespace james {
+namespace collada {
+
+  // A <polylist>'s <vcount>. Only the run of triangles it starts with is counted, so a
+  // list of triangles takes no room; the counts from the first other polygon on are
+  // kept. With none kept, the polylist is taken to be all triangles.
+  struct PolygonCounts {
+    size_t leadingTriangles;
+    VertexIndex::IndexList rest;
+    size_t triangles;          // That the polygons make once triangulated
+
+    PolygonCounts() : leadingTriangles(0), triangles(0) {}
+
+    void Add(unsigned int count) {
+      if (count == 3 && rest.empty()) {
+        leadingTriangles++;
+      }
+      else {
+        rest.push_back(count);
+      }
+      triangles += (count >= 3) ? count - 2 : 0;
+    }
+
+    // Appends the counts that followed these in the document
+    void Append(const PolygonCounts& next);
+
+    bool TrianglesOnly() const { return rest.empty(); }
+  };
+
+  // Writes a <polylist>'s triangles into out as the indices of its <p> arrive, one at a
+  // time. Triangles are passed straight through; a polygon's corners are held until it's
+  // complete, and then it's written as a fan if it's convex or ear clipped if not. Each
+  // triangle is written as three corners of <p>, all of each corner's indices, so out
+  // reads as a <polylist> of triangles. Polygons of fewer than three corners, and
+  // indices after the last polygon, are dropped.
+  struct PolygonTriangulator {
+    PolygonTriangulator() : counts_(nullptr), out_(nullptr), direct_(0), next_(0), stride_(1), positions_(nullptr) {}
+
+    // For a <polylist> with the given counts, stride indices per corner and (unless it's
+    // null) positions to tell the shape of its polygons by. Without positions, every
+    // polygon is written as a fan. counts and positions must outlive the writing.
+    void Begin(const PolygonCounts& counts, size_t stride, const ResolvedInput* positions,
+      VertexIndex::IndexList& out);
+
+    // For a <polygons>, whose polygons come whole, one to a <p>, and are written with
+    // AddPolygon instead of Add
+    void Begin(size_t stride, const ResolvedInput* positions, VertexIndex::IndexList& out);
+    void AddPolygon(const VertexIndex::IndexList& corners);
+
+    void Add(unsigned int index) {
+      if (direct_ > 0) {
+        direct_--;
+        out_->push_back(index);
+      }
+      else {
+        AddToPolygon(index);
+      }
+    }
+
+  private:
+    const PolygonCounts* counts_;
+    VertexIndex::IndexList* out_;
+    size_t direct_;   // Indices still to pass straight through
+    size_t next_;     // Into counts_->rest: the polygon being held
+    size_t stride_;
+    const ResolvedInput* positions_;
+
+    // Kept from one polygon to the next
+    std::vector<unsigned int> corners_;
+    std::vector<float> points_;
+    std::vector<unsigned int> links_;
+
+    void Advance();
+    void AddToPolygon(unsigned int index);
+    void WritePolygon(size_t n);
+    bool EarClip(size_t n);
+    void WriteCorner(size_t corner);
+  };
+
+  // Appends the triangles of a <tristrips> or <trifans> <p> to out, as three corners
+  // each. Triangles of a strip alternate in winding; each is written facing the way
+  // the first does. Triangles with two corners the same, which join strips, are dropped.
+  void WriteStrip(const VertexIndex::IndexList& corners, size_t stride, VertexIndex::IndexList& out);
+  void WriteFan(const VertexIndex::IndexList& corners, size_t stride, VertexIndex::IndexList& out);
+
+  // Appends a <tristrips> <p> to out as it is, after a corner of RESTART_INDEX if out
+  // already holds a strip
+  void AppendStrip(const VertexIndex::IndexList& corners, size_t stride, VertexIndex::IndexList& out);
+
+  // Triangulates a whole <p>, decoded as it was, into out
+  void Triangulate(const VertexIndex::IndexList& indices, const PolygonCounts& counts, size_t stride,
+    const ResolvedInput* positions, VertexIndex::IndexList& out);
+
+} // namespace collada
+} // namespace james
\ No newline at end of file
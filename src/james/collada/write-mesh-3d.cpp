@@ -0,0 +1,221 @@
+#include "write-mesh-3d.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+using namespace std;
+
+namespace james {
+namespace collada {
+
+  namespace {
+
+    // The indices a corner of a <polylist> has into its inputs
+    struct VertexKey {
+      unsigned int position;
+      unsigned int normal;
+      unsigned int texCoord;
+
+      bool operator ==(const VertexKey& other) const {
+        return position == other.position && normal == other.normal && texCoord == other.texCoord;
+      }
+    };
+
+    const unsigned int EMPTY = (unsigned int)-1;
+
+    // Numbers distinct VertexKeys in order of first insertion, with an open-addressing
+    // hash table (linear probing, at most half full) over the keys' numbers
+    struct VertexTable {
+      // Room for up to maxKeys distinct keys
+      explicit VertexTable(size_t maxKeys)
+        : mask_(0)
+      {
+        size_t capacity = 16;
+        while (capacity < maxKeys * 2) {
+          capacity *= 2;
+        }
+
+        slots_.assign(capacity, EMPTY);
+        mask_ = capacity - 1;
+        keys_.reserve(maxKeys);
+      }
+
+      unsigned int Insert(const VertexKey& key) {
+        size_t slot = Hash(key) & mask_;
+
+        for (;;) {
+          unsigned int n = slots_[slot];
+          if (n == EMPTY) {
+            n = (unsigned int)keys_.size();
+            slots_[slot] = n;
+            keys_.push_back(key);
+            return n;
+          }
+          if (keys_[n] == key) {
+            return n;
+          }
+          slot = (slot + 1) & mask_;
+        }
+      }
+
+      const vector<VertexKey>& Keys() const { return keys_; }
+
+    private:
+      vector<unsigned int> slots_;
+      size_t mask_;
+      vector<VertexKey> keys_;
+
+      static size_t Hash(const VertexKey& key) {
+        uint64_t h = key.position * 0x9e3779b97f4a7c15ull;
+        h = (h ^ key.normal) * 0xc2b2ae3d27d4eb4full;
+        h = (h ^ key.texCoord) * 0x165667b19e3779f9ull;
+        return (size_t)(h ^ (h >> 32));
+      }
+    };
+
+  }
+
+  bool ResolveInput(const Mesh::SourceList& sources, const Mesh::AccessorList& accessors,
+    const VertexIndex::Input& input, size_t width, ResolvedInput& out
+  ) {
+    if (input.accessor >= accessors.size()) {
+      return false;
+    }
+
+    const Accessor& a = accessors[input.accessor];
+    if (a.source >= sources.size() || sources[a.source].data.empty()) {
+      return false;
+    }
+
+    const FloatSource& source = sources[a.source].data;
+
+    const size_t params[3] = { a.aIndex, a.bIndex, a.cIndex };
+    size_t reach = 0;
+    for (size_t c = 0; c < width; c++) {
+      if (params[c] == Accessor::NOT_PRESENT) {
+        return false;
+      }
+      out.components[c] = params[c];
+      reach = max(reach, params[c] + 1);
+    }
+
+    out.data = source.data();
+    out.offset = a.offset;
+    out.stride = max(a.stride, (size_t)1);
+    out.width = width;
+    out.indexOffset = input.offset;
+
+    // The elements the source really holds, whatever the accessor's count says
+    size_t size = source.size();
+    size_t available = (size < a.offset + reach) ? 0 : (size - a.offset - reach) / out.stride + 1;
+    out.count = (a.count > 0) ? min(a.count, available) : available;
+
+    return true;
+  }
+
+  bool WriteMesh3d(const Mesh::SourceList& sources, const Mesh::AccessorList& accessors,
+    const VertexIndex& part, Mesh3dBuffer& out
+  ) {
+    ResolvedInput position, normal, texCoord;
+    if (!ResolveInput(sources, accessors, part.position, 3, position)) {
+      return false;
+    }
+
+    bool hasNormals = ResolveInput(sources, accessors, part.normals, 3, normal);
+    bool hasTexCoords = ResolveInput(sources, accessors, part.texCoords, 2, texCoord);
+
+    size_t indexStride = max(part.stride, max(max(part.position.offset, part.normals.offset), part.texCoords.offset) + 1);
+    const bool strips = part.topology == VertexIndex::TRIANGLE_STRIP;
+    size_t vertexCount = part.indices.size() / indexStride;
+    if (!strips) {
+      vertexCount -= vertexCount % 3;
+    }
+    if (vertexCount == 0) {
+      return false;
+    }
+
+    // Weld the corners: a vertex for each distinct combination of indices
+    VertexTable table(vertexCount);
+    std::vector<unsigned int> indices(vertexCount);
+
+    const unsigned int* index = part.indices.data();
+    for (size_t v = 0; v < vertexCount; v++, index += indexStride) {
+      if (strips && index[position.indexOffset] == RESTART_INDEX) {
+        indices[v] = PRIMITIVE_RESTART;
+        continue;
+      }
+
+      VertexKey key = {
+        index[position.indexOffset],
+        hasNormals ? index[normal.indexOffset] : 0,
+        hasTexCoords ? index[texCoord.indexOffset] : 0
+      };
+      indices[v] = table.Insert(key);
+    }
+
+    unsigned int stride = 3 + (hasNormals ? 3 : 0) + (hasTexCoords ? 2 : 0);
+    std::vector<float> data(table.Keys().size() * stride);
+
+    float* p = data.data();
+    for (const VertexKey& key : table.Keys()) {
+      if (!position.Read(key.position, p)) {
+        return false;
+      }
+      p += 3;
+
+      if (hasNormals) {
+        if (!normal.Read(key.normal, p)) {
+          return false;
+        }
+        p += 3;
+      }
+
+      if (hasTexCoords) {
+        if (!texCoord.Read(key.texCoord, p)) {
+          return false;
+        }
+        p += 2;
+      }
+    }
+
+    out.xyzOffset = 0;
+    out.normalsOffset = hasNormals ? 3 : Mesh3dBuffer::NOT_PRESENT;
+    out.uvOffset = hasTexCoords ? (hasNormals ? 6 : 3) : Mesh3dBuffer::NOT_PRESENT;
+    out.stride = stride;
+    out.topology = strips ? Mesh3d::TRIANGLE_STRIP : Mesh3d::TRIANGLE_LIST;
+    BoundPoints(data.data(), stride, table.Keys().size(), out.bounds);
+    out.data = move(data);
+    out.indices = move(indices);
+
+    return true;
+  }
+
+  bool BoundPart(const Mesh::SourceList& sources, const Mesh::AccessorList& accessors, VertexIndex& part) {
+    ResolvedInput position;
+    if (!ResolveInput(sources, accessors, part.position, 3, position)) {
+      return false;
+    }
+
+    // Each position used, once, in order of first use. This may run on any thread, so
+    // nothing comes from the arena.
+    std::vector<bool> used(position.count, false);
+    std::vector<float> points;
+
+    const size_t indexStride = max(part.stride, position.indexOffset + 1);
+    const size_t corners = part.indices.size() / indexStride;
+    const unsigned int* index = part.indices.data() + position.indexOffset;
+    for (size_t i = 0; i < corners; i++, index += indexStride) {
+      if (*index < position.count && !used[*index]) {
+        used[*index] = true;
+        points.resize(points.size() + 3);
+        position.Read(*index, &points[points.size() - 3]);
+      }
+    }
+
+    BoundPoints(points.data(), 3, points.size() / 3, part.bounds);
+    return true;
+  }
+
+} // namespace collada
+} // namespace james
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "dom.hpp"
+#include "../model-3d.hpp"
+
+namespace james {
+namespace collada {
+
+  // A <polylist> input, resolved to the floats it reads
+  struct ResolvedInput {
+    const float* data;
+    size_t offset;        // Of the first element, in floats
+    size_t stride;        // Floats per element
+    size_t count;         // Elements that can be read
+    size_t width;         // Components read from each element
+    size_t components[3];
+    size_t indexOffset;   // Of the input's index in each vertex of <p>
+
+    // Copies element i's components to out; false if there isn't an element i
+    bool Read(unsigned int i, float* out) const {
+      if (i >= count) {
+        return false;
+      }
+
+      const float* element = data + offset + i * stride;
+      for (size_t c = 0; c < width; c++) {
+        out[c] = element[components[c]];
+      }
+      return true;
+    }
+  };
+
+  // Resolves the input through the <mesh>'s accessors and sources, reading width
+  // components of each element; false if it doesn't lead to that many floats
+  bool ResolveInput(const Mesh::SourceList& sources, const Mesh::AccessorList& accessors,
+    const VertexIndex::Input& input, size_t width, ResolvedInput& out);
+
+  // Writes a part's triangles (or strips, kept as strips) into out as interleaved
+  // positions, normals and texture coordinates, reading its inputs through the <mesh>'s
+  // accessors and sources. Normals and texture coordinates that can't be
+  // found are left out. Returns false, with out unchanged, if the positions can't be
+  // found or an index is out of range.
+  //
+  // Corners of the part with the same combination of position, normal and texture
+  // coordinate indices become one vertex, in order of first use.
+  //
+  // out's bounds are those of its positions; its id and material aren't set.
+  //
+  // Models are cached as they're written: a change to what's written here has to bump
+  // LOADER_REVISION in model-cache.cpp.
+  bool WriteMesh3d(const Mesh::SourceList& sources, const Mesh::AccessorList& accessors,
+    const VertexIndex& part, Mesh3dBuffer& out);
+
+  // Sets the part's bounds to those of the positions its corners use, reading them
+  // through the <mesh>'s accessors and sources. Returns false, with the bounds left
+  // alone, if the positions can't be found; indices out of range are passed over.
+  bool BoundPart(const Mesh::SourceList& sources, const Mesh::AccessorList& accessors, VertexIndex& part);
+
+} // namespace collada
+} // namespace james
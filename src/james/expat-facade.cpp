@@ -0,0 +1,84 @@
+#include <james/expat-facade.hpp>
+
+#include <atomic>
+
+namespace james {
+
+  namespace {
+
+    std::atomic<unsigned int> lastDocument(0);
+
+  }
+
+  unsigned int NextDocument() {
+    unsigned int document = ++lastDocument;
+    return (document != 0) ? document : ++lastDocument;
+  }
+
+  //
+  // Attributes
+  //
+
+  Attributes::Attributes(const char** data)
+    : data_(data), document_(0)
+  {}
+
+  Attributes::Attributes(const char** data, unsigned int document)
+    : data_(data), document_(document)
+  {}
+
+  Attributes::Iterator begin(const Attributes& attributes) {
+    return Attributes::Iterator(attributes.data_);
+  }
+
+  Attributes::Iterator end(const Attributes& attributes) {
+    return Attributes::Iterator(attributes.data_ + 2 * attributes.Length());
+  }
+
+  //
+  // ExpatFacade
+  //
+
+  ExpatFacade::ExpatFacade()
+    : tags_(1)
+  {}
+
+  void ExpatFacade::ListenFor(const std::string& path, const Tag& tag) {
+    PathTrie::NodeIndex node = AddPath(path, bool(tag.TextContent), bool(tag.TextChunk));
+    tags_.resize(NodeCount());
+    tags_[node].push_back(tag);
+  }
+
+  void ExpatFacade::Opened(PathTrie::NodeIndex node, const Path& path, const Attributes& attributes) {
+    for (const Tag& tag : tags_[node]) {
+      if (tag.TagOpened) {
+        tag.TagOpened(path, attributes);
+      }
+    }
+  }
+
+  void ExpatFacade::Closed(PathTrie::NodeIndex node, const Path& path) {
+    for (const Tag& tag : tags_[node]) {
+      if (tag.TagClosed) {
+        tag.TagClosed(path);
+      }
+    }
+  }
+
+  void ExpatFacade::Text(PathTrie::NodeIndex node, const Path& path, const std::string& text) {
+    for (const Tag& tag : tags_[node]) {
+      if (tag.TextContent) {
+        tag.TextContent(path, text);
+      }
+    }
+  }
+
+  void ExpatFacade::Chunk(PathTrie::NodeIndex node, const Path& path, StringView chunk) {
+    for (const Tag& tag : tags_[node]) {
+      if (tag.TextChunk) {
+        tag.TextChunk(path, chunk);
+      }
+    }
+  }
+
+} // james
@@ -0,0 +1,120 @@
+#include <james/expat-parser-dispatcher.hpp>
+
+namespace james {
+
+  ExpatParserDispatcher::ExpatParserDispatcher()
+    : defaultConsumer_(nullptr), consumers_(1), unmatchedDepth_(0)
+  {
+    openNodes_.reserve(32);
+    openNodes_.push_back(PathTrie::ROOT);
+  }
+
+  void ExpatParserDispatcher::AddConsumer(const std::string& tagName, XMLConsumer* consumer) {
+    PathTrie::NodeIndex node = paths_.Insert(tagName);
+    consumers_.resize(paths_.Size());
+    consumers_[node].push_back(consumer);
+  }
+
+  void ExpatParserDispatcher::SetDefaultConsumer(XMLConsumer* consumer) {
+    defaultConsumer_ = consumer;
+  }
+
+  const ExpatParserDispatcher::ConsumerList* ExpatParserDispatcher::CurrentConsumers() const {
+    if (unmatchedDepth_ > 0) {
+      return nullptr;
+    }
+
+    const ConsumerList& consumers = consumers_[openNodes_.back()];
+    return consumers.empty() ? nullptr : &consumers;
+  }
+
+  void ExpatParserDispatcher::StartElement(const char *name, const char **atts) {
+    currentNode_.depth++;
+
+    PathTrie::NodeIndex node = (unmatchedDepth_ > 0) ? PathTrie::NO_NODE : paths_.Child(openNodes_.back(), name);
+
+    if (node != PathTrie::NO_NODE) {
+      openNodes_.push_back(node);
+      currentNode_.name = paths_.Name(node);
+      currentNode_.path = paths_.Path(node);
+    }
+    else {
+      currentNode_.name = name;
+      if (defaultConsumer_) {
+        if (unmatchedDepth_ == 0) {
+          unmatchedPath_ = paths_.Path(openNodes_.back());
+        }
+        unmatchedPath_ += '/';
+        unmatchedPath_ += name;
+        currentNode_.path = unmatchedPath_;
+      }
+      else if (unmatchedDepth_ == 0) {
+        // Nobody can see anything inside this element
+        SkipElement();
+      }
+      unmatchedDepth_++;
+    }
+
+    if (const ConsumerList* consumers = CurrentConsumers()) {
+      for (XMLConsumer* consumer : *consumers) {
+        consumer->StartElement(currentNode_, atts);
+      }
+    }
+    else if (defaultConsumer_) {
+      defaultConsumer_->StartElement(currentNode_, atts);
+    }
+  }
+
+  void ExpatParserDispatcher::EndElement(const char *name) {
+    if (unmatchedDepth_ > 0) {
+      currentNode_.name = name;
+    }
+    else {
+      currentNode_.name = paths_.Name(openNodes_.back());
+    }
+
+    if (const ConsumerList* consumers = CurrentConsumers()) {
+      for (XMLConsumer* consumer : *consumers) {
+        consumer->EndElement(currentNode_);
+      }
+    }
+    else if (defaultConsumer_) {
+      defaultConsumer_->EndElement(currentNode_);
+    }
+
+    currentNode_.depth--;
+
+    if (unmatchedDepth_ > 0) {
+      unmatchedDepth_--;
+
+      if (defaultConsumer_) {
+        unmatchedPath_.erase(unmatchedPath_.length() - strlen(name) - 1);
+      }
+    }
+    else {
+      openNodes_.pop_back();
+    }
+
+    if (unmatchedDepth_ > 0 && defaultConsumer_) {
+      size_t slash = unmatchedPath_.rfind('/') + 1;
+      currentNode_.path = unmatchedPath_;
+      currentNode_.name = StringView(unmatchedPath_.data() + slash, unmatchedPath_.size() - slash);
+    }
+    else {
+      currentNode_.path = paths_.Path(openNodes_.back());
+      currentNode_.name = paths_.Name(openNodes_.back());
+    }
+  }
+
+  void ExpatParserDispatcher::CharacterData(const XML_Char *s, int len) {
+    if (const ConsumerList* consumers = CurrentConsumers()) {
+      for (XMLConsumer* consumer : *consumers) {
+        consumer->CharacterData(currentNode_, s, len);
+      }
+    }
+    else if (defaultConsumer_) {
+      defaultConsumer_->CharacterData(currentNode_, s, len);
+    }
+  }
+
+} // james
@@ -0,0 +1,360 @@
+#include <james/expat-parser.hpp>
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace james {
+
+  ExpatParser::ExpatParser(XMLConsumer& consumer, RegisteredHandlers handlers)
+    : consumer_(consumer), parser_(XML_ParserCreate(nullptr)), handlers_(handlers), done_(false),
+      skipDepth_(0), skipStart_(0)
+  {
+    if (!parser_) {
+      throw std::runtime_error("Unable to create Expat parser (XML_ParserCreate failed)");
+    }
+
+    XML_SetUserData(parser_, this);
+    SetHandlers(false);
+
+#if XML_MAJOR_VERSION > 2 || (XML_MAJOR_VERSION == 2 && XML_MINOR_VERSION >= 6)
+    // Expat 2.6+ can postpone re-tokenising an incomplete token until enough new input
+    // has arrived to make progress likely; without it a huge token fed in small pieces
+    // is rescanned once per piece.
+    XML_SetReparseDeferralEnabled(parser_, XML_TRUE);
+#endif
+  }
+
+  ExpatParser::~ExpatParser() {
+    XML_ParserFree(parser_);
+  }
+
+  void ExpatParser::Parse(const char* data, size_t length, bool done) {
+    assert(!done_);
+
+    done_ = done;
+    currentException_ = nullptr;
+
+    if (XML_Parse(parser_, data, (int)length, done) == XML_STATUS_ERROR) {
+      ThrowParseError();
+    }
+  }
+
+  void ExpatParser::Parse(const std::string& data, bool done) {
+    Parse(data.data(), data.size(), done);
+  }
+
+  char* ExpatParser::GetBuffer(size_t length) {
+    assert(!done_);
+
+    void* buffer = XML_GetBuffer(parser_, (int)length);
+    if (!buffer) {
+      throw Exception(XML_ErrorString(XML_GetErrorCode(parser_)), XML_GetErrorCode(parser_), XML_GetCurrentLineNumber(parser_));
+    }
+
+    return static_cast<char*>(buffer);
+  }
+
+  void ExpatParser::ParseBuffer(size_t length, bool done) {
+    assert(!done_);
+
+    done_ = done;
+    currentException_ = nullptr;
+
+    if (XML_ParseBuffer(parser_, (int)length, done) == XML_STATUS_ERROR) {
+      ThrowParseError();
+    }
+  }
+
+  size_t ExpatParser::PendingBytes() const {
+    int offset = 0;
+    int size = 0;
+
+    // Requires expat to be built with XML_CONTEXT_BYTES (the default); otherwise
+    // nothing is reported as pending.
+    if (XML_GetInputContext(parser_, &offset, &size) && size > offset) {
+      return (size_t)(size - offset);
+    }
+    return 0;
+  }
+
+  void ExpatParser::SetHandlers(bool skipping) {
+    if (skipping) {
+      // Without a character data handler expat doesn't assemble text runs at all; the
+      // other handlers are cleared so that nothing reaches the default handler instead
+      XML_SetElementHandler(parser_, SkipStartElement, SkipEndElement);
+      XML_SetCharacterDataHandler(parser_, nullptr);
+      XML_SetDefaultHandler(parser_, nullptr);
+      XML_SetProcessingInstructionHandler(parser_, nullptr);
+      XML_SetCommentHandler(parser_, nullptr);
+      XML_SetCdataSectionHandler(parser_, nullptr, nullptr);
+      return;
+    }
+
+    XML_SetElementHandler(parser_, StartElement, EndElement);
+    XML_SetCharacterDataHandler(parser_, CharacterDataHandler);
+
+    if (handlers_ & DEFAULT_HANDLER) {
+      XML_SetDefaultHandler(parser_, DefaultHandler);
+    }
+    if (handlers_ & PI_HANDLER) {
+      XML_SetProcessingInstructionHandler(parser_, ProcessingInstruction);
+    }
+    if (handlers_ & COMMENT_HANDLER) {
+      XML_SetCommentHandler(parser_, Comment);
+    }
+    if (handlers_ & CDATA_HANDLER) {
+      XML_SetCdataSectionHandler(parser_, StartCData, EndCData);
+    }
+  }
+
+  void ExpatParser::BeginSkip() {
+    skipDepth_ = 1;
+    skipStart_ = XML_GetCurrentByteIndex(parser_);
+    SetHandlers(true);
+  }
+
+  void ExpatParser::ThrowParseError() {
+    if (currentException_) {
+      std::rethrow_exception(currentException_);
+    }
+
+    throw Exception(XML_ErrorString(XML_GetErrorCode(parser_)), XML_GetErrorCode(parser_), XML_GetCurrentLineNumber(parser_));
+  }
+
+  //
+  // Expat callbacks. Exceptions must not propagate through expat's C stack frames, so
+  // each callback stops the parser and stashes the exception for Parse to rethrow.
+  //
+
+  void XMLCALL ExpatParser::StartElement(void *userData, const char *name, const char **atts) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+    if (self->currentException_) { return; }
+
+    try {
+      self->consumer_.skipRequested_ = false;
+      self->consumer_.StartElement(name, atts);
+
+      if (self->consumer_.skipRequested_) {
+        self->BeginSkip();
+      }
+    }
+    catch (...) {
+      XML_StopParser(self->parser_, XML_FALSE);
+      self->currentException_ = std::current_exception();
+    }
+  }
+
+  void XMLCALL ExpatParser::EndElement(void *userData, const char *name) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+    if (self->currentException_) { return; }
+
+    try {
+      self->consumer_.EndElement(name);
+    }
+    catch (...) {
+      XML_StopParser(self->parser_, XML_FALSE);
+      self->currentException_ = std::current_exception();
+    }
+  }
+
+  void XMLCALL ExpatParser::SkipStartElement(void *userData, const char *name, const char **atts) {
+    static_cast<ExpatParser*>(userData)->skipDepth_++;
+  }
+
+  void XMLCALL ExpatParser::SkipEndElement(void *userData, const char *name) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+
+    if (--self->skipDepth_ > 0) {
+      return;
+    }
+
+    self->skipped_.elements++;
+    self->skipped_.bytes += (unsigned long long)(XML_GetCurrentByteIndex(self->parser_) - self->skipStart_);
+    self->SetHandlers(false);
+
+    // The skipped element's own end tag is still reported
+    EndElement(userData, name);
+  }
+
+  void XMLCALL ExpatParser::CharacterDataHandler(void *userData, const XML_Char *s, int len) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+    if (self->currentException_) { return; }
+
+    try {
+      self->consumer_.CharacterData(s, len);
+    }
+    catch (...) {
+      XML_StopParser(self->parser_, XML_FALSE);
+      self->currentException_ = std::current_exception();
+    }
+  }
+
+  void XMLCALL ExpatParser::DefaultHandler(void *userData, const XML_Char *s, int len) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+    if (self->currentException_) { return; }
+
+    try {
+      self->consumer_.DefaultHandler(s, len);
+    }
+    catch (...) {
+      XML_StopParser(self->parser_, XML_FALSE);
+      self->currentException_ = std::current_exception();
+    }
+  }
+
+  void XMLCALL ExpatParser::ProcessingInstruction(void *userData, const XML_Char *target, const XML_Char *data) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+    if (self->currentException_) { return; }
+
+    try {
+      self->consumer_.ProcessingInstruction(target, data);
+    }
+    catch (...) {
+      XML_StopParser(self->parser_, XML_FALSE);
+      self->currentException_ = std::current_exception();
+    }
+  }
+
+  void XMLCALL ExpatParser::Comment(void *userData, const XML_Char *data) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+    if (self->currentException_) { return; }
+
+    try {
+      self->consumer_.Comment(data);
+    }
+    catch (...) {
+      XML_StopParser(self->parser_, XML_FALSE);
+      self->currentException_ = std::current_exception();
+    }
+  }
+
+  void XMLCALL ExpatParser::StartCData(void *userData) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+    if (self->currentException_) { return; }
+
+    try {
+      self->consumer_.StartCData();
+    }
+    catch (...) {
+      XML_StopParser(self->parser_, XML_FALSE);
+      self->currentException_ = std::current_exception();
+    }
+  }
+
+  void XMLCALL ExpatParser::EndCData(void *userData) {
+    ExpatParser* self = static_cast<ExpatParser*>(userData);
+    if (self->currentException_) { return; }
+
+    try {
+      self->consumer_.EndCData();
+    }
+    catch (...) {
+      XML_StopParser(self->parser_, XML_FALSE);
+      self->currentException_ = std::current_exception();
+    }
+  }
+
+  //
+  // Non-member utility functions
+  //
+
+  bool HasAttribute(const char** atts, const char* name) {
+    for (std::size_t i = 0; atts[i]; i += 2) {
+      if (strcmp(atts[i], name) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const char* FindAttribute(const char** atts, const char* name, const char* defaultVal) {
+    for (std::size_t i = 0; atts[i]; i += 2) {
+      if (strcmp(atts[i], name) == 0) {
+        return atts[i + 1];
+      }
+    }
+    return defaultVal;
+  }
+
+  namespace {
+
+    // Reaching the end of the stream is how both ParseStream variants detect the end of
+    // the document, so an eofbit exception mask is suspended while they run.
+    struct EofExceptionsSuspended {
+      explicit EofExceptionsSuspended(std::istream& src)
+        : src_(src), oldExceptions_(src.exceptions())
+      {
+        src_.exceptions(oldExceptions_ & ~std::ios::eofbit);
+      }
+
+      ~EofExceptionsSuspended() {
+        src_.clear(src_.rdstate() & ~std::ios::eofbit);
+        src_.exceptions(oldExceptions_);
+      }
+
+    private:
+      std::istream& src_;
+      std::ios::iostate oldExceptions_;
+    };
+
+    // A stream that fails for any reason other than reaching its end - a file that
+    // couldn't be opened, or can't be read - never sets eofbit, so the read loops would
+    // never finish
+    void CheckStream(const std::istream& src) {
+      if (src.bad() || (src.fail() && !src.eof())) {
+        throw ExpatParser::Exception("Error reading the document", XML_ERROR_NONE, 0);
+      }
+    }
+
+  }
+
+  void ParseStream(ExpatParser& parser, std::istream& src, size_t bufferSize) {
+    std::vector<char> buffer(bufferSize, 0);
+    EofExceptionsSuspended guard(src);
+    CheckStream(src);
+
+    for (;;) {
+      src.read(&buffer[0], buffer.size());
+      CheckStream(src);
+
+      std::streamsize n = src.gcount();
+      if (n > 0) {
+        parser.Parse(&buffer[0], (size_t)n, false);
+      }
+
+      if (src.eof()) {
+        break;
+      }
+    }
+
+    parser.Parse(&buffer[0], 0, true);
+  }
+
+  void ParseStreamInPlace(ExpatParser& parser, std::istream& src, size_t initialReadSize, size_t maxReadSize) {
+    EofExceptionsSuspended guard(src);
+    CheckStream(src);
+    size_t readSize = initialReadSize;
+
+    for (;;) {
+      char* buffer = parser.GetBuffer(readSize);
+      src.read(buffer, readSize);
+      CheckStream(src);
+
+      bool done = src.eof();
+      parser.ParseBuffer((size_t)src.gcount(), done);
+
+      if (done) {
+        break;
+      }
+
+      // Expat restarts an incomplete token from its first byte each time more input
+      // arrives. Growing the read geometrically while such a token is outstanding keeps
+      // the total rescanning proportional to the token's length.
+      if (parser.PendingBytes() > readSize / 2 && readSize < maxReadSize) {
+        readSize *= 2;
+      }
+    }
+  }
+
+}
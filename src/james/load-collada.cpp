@@ -1,22 +1,170 @@
 #include "load-collada.hpp"
 
 #include <james/expat-parser.hpp>
-#include <james/expat-facade.hpp>
+#include <james/simd-xml-parser.hpp>
 #include "collada/builder.hpp"
+#include "arena.hpp"
+#include "mapped-file.hpp"
+#include "model-cache.hpp"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 using namespace james::collada;
 
 namespace james {
 
-  Model3d LoadCollada(std::istream& src) {
-    
-    ExpatFacade facade;
-    ExpatParser parser(facade.XMLConsumer());
-    Builder builder(facade);
+  namespace {
 
-    ParseStream(parser, src);
+    // Expat takes an int length, so in-memory documents are handed over in slices.
+    // XML_Parse copies each slice into expat's own buffer before parsing it, so this
+    // path copies the whole document, 16MB at a time; mapped and in-memory documents
+    // are only parsed without a copy by SimdXmlParser, which AUTO_PARSER uses for them.
+    const size_t SLICE_SIZE = 16 * 1024 * 1024;
 
-    return Model3d();
+    void ParseMemory(ExpatParser& parser, const char* data, size_t length) {
+      while (length > SLICE_SIZE) {
+        parser.Parse(data, SLICE_SIZE, false);
+        data += SLICE_SIZE;
+        length -= SLICE_SIZE;
+      }
+      parser.Parse(data, length, true);
+    }
+
+    // Deferred decoding relies on the parser leaving text in place, so it is only
+    // used with SimdXmlParser; decodeThreads is 1 otherwise
+    template <typename Parser, typename ParseFunc>
+    Model3d Load(ParseFunc parse, unsigned int decodeThreads, const LoadOptions& options) {
+      // The builder's temporaries come from the arena, and go with it all at once
+      Arena arena(options.hugePages);
+      ArenaScope scope(arena);
+
+      Builder builder;
+      builder.EmitModel();
+      if (options.keepStrips) {
+        builder.KeepStrips();
+      }
+      if (decodeThreads != 1) {
+        builder.DeferDecoding();
+      }
+
+      Parser parser(builder.XMLConsumer());
+      parse(parser);
+
+      builder.DecodeDeferred(decodeThreads);
+
+      if (options.optimizeMeshes) {
+        builder.OptimizeMeshes(options.threads, options.optimizationReport);
+      }
+      if (options.buildMeshlets) {
+        builder.BuildMeshlets(options.threads, options.meshletVertices, options.meshletTriangles);
+      }
+
+      return builder.TakeModel(options.encoding);
+    }
+
+    Model3d Parse(const char* data, size_t length, const LoadOptions& options) {
+      if (options.parser != LoadOptions::EXPAT_PARSER) {
+        try {
+          return Load<SimdXmlParser>([data, length](SimdXmlParser& parser) {
+            parser.Parse(data, length);
+          }, options.threads, options);
+        }
+        catch (const SimdXmlParser::Unsupported&) {
+          // Start again from scratch; expat reads the whole of XML
+        }
+      }
+
+      return Load<ExpatParser>([data, length](ExpatParser& parser) {
+        ParseMemory(parser, data, length);
+      }, 1, options);
+    }
+
+    // The rest of the stream. As in ParseStream, a stream that can't be read throws
+    // ExpatParser::Exception rather than passing for an empty document.
+    std::string ReadAll(std::istream& src) {
+      bool failed = src.bad() || (src.fail() && !src.eof()) || !src.rdbuf();
+
+      std::string data;
+      std::vector<char> chunk(64 * 1024);
+      try {
+        std::streamsize n;
+        while (!failed && (n = src.rdbuf()->sgetn(chunk.data(), (std::streamsize)chunk.size())) > 0) {
+          data.append(chunk.data(), (size_t)n);
+        }
+      }
+      catch (const std::exception&) {
+        // Buffers report read errors by throwing (std::filebuf does for a directory)
+        failed = true;
+      }
+
+      if (failed) {
+        throw ExpatParser::Exception("Error reading the document", XML_ERROR_NONE, 0);
+      }
+      return data;
+    }
+
+    // Models loaded with options that change them are cached apart from the others
+    std::string CachePath(const std::string& directory, std::uint64_t contentHash, const LoadOptions& options) {
+      unsigned int variant = (options.optimizeMeshes ? 1 : 0)
+        | (options.encoding.position << 1) | (options.encoding.normal << 4) | (options.encoding.texCoord << 7)
+        | (options.encoding.layout << 10) | (options.keepStrips ? 1 << 12 : 0);
+
+      char name[64];
+      if (options.buildMeshlets) {
+        snprintf(name, sizeof(name), "%016llx-%03x-m%ux%u.model", (unsigned long long)contentHash, variant,
+          options.meshletVertices, options.meshletTriangles);
+      }
+      else {
+        snprintf(name, sizeof(name), "%016llx-%03x.model", (unsigned long long)contentHash, variant);
+      }
+
+      const char last = directory.back();
+      return (last == '/' || last == '\\') ? directory + name : directory + "/" + name;
+    }
+
+  }
+
+  Model3d LoadCollada(std::istream& src, const LoadOptions& options) {
+    // Documents are hashed whole to find them in the cache
+    if (options.parser == LoadOptions::SIMD_PARSER || !options.cacheDirectory.empty()) {
+      const std::string data = ReadAll(src);
+      return LoadCollada(data.data(), data.size(), options);
+    }
+
+    return Load<ExpatParser>([&src](ExpatParser& parser) {
+      ParseStreamInPlace(parser, src);
+    }, 1, options);
+  }
+
+  Model3d LoadCollada(const char* path, const LoadOptions& options) {
+    MappedFile file(path);
+
+    return LoadCollada(file.Data(), file.Size(), options);
+  }
+
+  Model3d LoadCollada(const char* data, size_t length, const LoadOptions& options) {
+    if (options.cacheDirectory.empty()) {
+      return Parse(data, length, options);
+    }
+
+    const std::uint64_t hash = ContentHash(data, length);
+    const std::string path = CachePath(options.cacheDirectory, hash, options);
+
+    Model3d model;
+    if (LoadModelCache(path.c_str(), hash, model)) {
+      return model;
+    }
+
+    model = Parse(data, length, options);
+    try {
+      SaveModelCache(model, path.c_str(), hash);
+    }
+    catch (const std::runtime_error&) {
+      // The model is still good; the next load will just parse it again
+    }
+    return model;
   }
 
-} // namespace james
+} // namespace james
\ No newline at end of file
@@ -1,10 +1,79 @@
 #pragma once
 
 #include <istream>
+#include <string>
+#include <james/meshlets.hpp>
 #include <james/model-3d.hpp>
+#include <james/optimize-mesh.hpp>
 
 namespace james {
 
-  Model3d LoadCollada(std::istream& src);
+  struct LoadOptions {
+    enum Parser {
+      // SimdXmlParser for documents in memory (including mapped files) and expat for
+      // streams
+      AUTO_PARSER,
+      EXPAT_PARSER,
+      // SimdXmlParser everywhere; streams are read into memory first
+      SIMD_PARSER
+    };
+
+    // Documents SimdXmlParser doesn't support are loaded again with expat
+    Parser parser;
+
+    // Threads decoding the numbers in <float_array>, <p> and <vcount>; 0 means one per
+    // core. Documents read by SimdXmlParser are decoded after the parse and in parallel
+    // unless this is 1; otherwise the numbers are decoded while parsing.
+    unsigned int threads;
+
+    // Back large allocations made while loading with transparent huge pages, where
+    // the platform has them (Linux)
+    bool hugePages;
+
+    // Reorder each mesh's triangles for the GPU's post-transform vertex cache, and then
+    // its vertices into the order the triangles use them (see OptimizeMesh). Meshes are
+    // optimised on as many threads as decoding.
+    bool optimizeMeshes;
+
+    // Split each mesh into meshlets of at most meshletVertices vertices and
+    // meshletTriangles triangles, with bounds to cull them by (see BuildMeshlets). It's
+    // done after optimizeMeshes, on as many threads.
+    bool buildMeshlets;
+    unsigned int meshletVertices;
+    unsigned int meshletTriangles;
+
+    // Keep <tristrips> as triangle strips joined by PRIMITIVE_RESTART indices, instead of
+    // turning them into triangle lists. Strips aren't optimised or split into meshlets.
+    bool keepStrips;
+
+    // The formats the model's vertices are stored in: 32-bit floats by default, or more
+    // compact ones that lose some precision
+    VertexEncoding encoding;
+
+    // If not null, the vertex cache stats of all the meshes before and after they're
+    // optimised are added to it. Models mapped from the cache aren't counted.
+    MeshOptimizationReport* optimizationReport;
+
+    // An existing directory to keep parsed models in, named by a hash of the document
+    // they came from. A document with a model there is not parsed again; its model is
+    // mapped from the cache file instead. Empty means no cache.
+    std::string cacheDirectory;
+
+    LoadOptions()
+      : parser(AUTO_PARSER), threads(0), hugePages(false), optimizeMeshes(false),
+        buildMeshlets(false), meshletVertices(MESHLET_VERTICES), meshletTriangles(MESHLET_TRIANGLES),
+        keepStrips(false), optimizationReport(nullptr) {}
+  };
+
+  // A document that can't be read or parsed throws ParseError, whichever parser is used
+  Model3d LoadCollada(std::istream& src, const LoadOptions& options = LoadOptions());
+
+  // Maps the file at path into memory and parses it, in place unless parser is
+  // EXPAT_PARSER (or the document is one SimdXmlParser doesn't support).
+  Model3d LoadCollada(const char* path, const LoadOptions& options = LoadOptions());
+
+  // Parses a document that is already in memory. As above, SimdXmlParser reads data in
+  // place; expat copies it into its own buffer, a slice at a time.
+  Model3d LoadCollada(const char* data, size_t length, const LoadOptions& options = LoadOptions());
 
 } // namespace james
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "mapped-file.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace james {
+
+#ifdef _WIN32
+
+  MappedFile::MappedFile(const char* path)
+    : data_(nullptr), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr)
+  {
+    file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file_ == INVALID_HANDLE_VALUE) {
+      throw std::runtime_error("Unable to open file: " + std::string(path));
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size)) {
+      CloseHandle(file_);
+      throw std::runtime_error("Unable to read file size: " + std::string(path));
+    }
+    size_ = (std::size_t)size.QuadPart;
+
+    // Zero-length files cannot be mapped; they are reported as empty instead.
+    if (size_ > 0) {
+      mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (mapping_) {
+        data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+      }
+
+      if (!data_) {
+        if (mapping_) { CloseHandle(mapping_); }
+        CloseHandle(file_);
+        throw std::runtime_error("Unable to map file: " + std::string(path));
+      }
+    }
+  }
+
+  MappedFile::~MappedFile() {
+    if (data_) { UnmapViewOfFile(data_); }
+    if (mapping_) { CloseHandle(mapping_); }
+    CloseHandle(file_);
+  }
+
+#else
+
+  MappedFile::MappedFile(const char* path)
+    : data_(nullptr), size_(0), fd_(-1)
+  {
+    fd_ = open(path, O_RDONLY);
+    if (fd_ < 0) {
+      throw std::runtime_error("Unable to open file: " + std::string(path));
+    }
+
+    struct stat info;
+    if (fstat(fd_, &info) != 0) {
+      close(fd_);
+      throw std::runtime_error("Unable to read file size: " + std::string(path));
+    }
+    size_ = (std::size_t)info.st_size;
+
+    // Zero-length files cannot be mapped; they are reported as empty instead.
+    if (size_ > 0) {
+      void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (p == MAP_FAILED) {
+        close(fd_);
+        throw std::runtime_error("Unable to map file: " + std::string(path));
+      }
+      madvise(p, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(p);
+    }
+  }
+
+  MappedFile::~MappedFile() {
+    if (data_) { munmap(const_cast<char*>(data_), size_); }
+    close(fd_);
+  }
+
+#endif
+
+} // namespace james
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+namespace james {
+
+  // Read-only view of a whole file mapped into the address space. The mapping lives
+  // as long as the MappedFile object does.
+  struct MappedFile {
+    explicit MappedFile(const char* path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator =(const MappedFile&) = delete;
+
+    const char* Data() const { return data_; }
+    std::size_t Size() const { return size_; }
+
+  private:
+    const char* data_;
+    std::size_t size_;
+
+#ifdef _WIN32
+    void* file_;
+    void* mapping_;
+#else
+    int fd_;
+#endif
+  };
+
+} // namespace james
@@ -0,0 +1,236 @@
+#include "meshlets.hpp"
+#include "bounds.hpp"
+#include "triangle-adjacency.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace james {
+
+  namespace {
+
+    const unsigned int NO_MESHLET = (unsigned int)-1;
+    const std::size_t NO_TRIANGLE = (std::size_t)-1;
+
+    void Subtract(const float* a, const float* b, float* out) {
+      for (int c = 0; c < 3; c++) {
+        out[c] = a[c] - b[c];
+      }
+    }
+
+    float Dot(const float* a, const float* b) {
+      return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    struct Positions {
+      const Mesh3dBuffer& mesh;
+      std::size_t count;
+
+      explicit Positions(const Mesh3dBuffer& mesh)
+        : mesh(mesh),
+          count((mesh.stride > 0 && mesh.xyzOffset != Mesh3dBuffer::NOT_PRESENT) ? mesh.data.size() / mesh.stride : 0) {}
+
+      const float* operator [](unsigned int v) const {
+        return &mesh.data[(std::size_t)v * mesh.stride + mesh.xyzOffset];
+      }
+    };
+
+    // About the mean of the triangles' normals, as wide as the normal farthest from it
+    void BoundCone(const Positions& positions, const unsigned int* indices, std::size_t triangleCount,
+      Meshlet& meshlet
+    ) {
+      std::vector<float> normals;
+      normals.reserve(triangleCount * 3);
+
+      float* axis = meshlet.coneAxis;
+      for (std::size_t t = 0; t < triangleCount; t++) {
+        const float* p0 = positions[indices[t * 3]];
+        float e1[3], e2[3];
+        Subtract(positions[indices[t * 3 + 1]], p0, e1);
+        Subtract(positions[indices[t * 3 + 2]], p0, e2);
+
+        float n[3] = {
+          e1[1] * e2[2] - e1[2] * e2[1],
+          e1[2] * e2[0] - e1[0] * e2[2],
+          e1[0] * e2[1] - e1[1] * e2[0]
+        };
+        float length = std::sqrt(Dot(n, n));
+        if (length == 0) {
+          continue;
+        }
+
+        for (int c = 0; c < 3; c++) {
+          normals.push_back(n[c] / length);
+          axis[c] += n[c] / length;
+        }
+      }
+
+      float length = std::sqrt(Dot(axis, axis));
+      if (length == 0) {
+        return;
+      }
+
+      float minDot = 1;
+      for (int c = 0; c < 3; c++) {
+        axis[c] /= length;
+      }
+      for (std::size_t i = 0; i < normals.size(); i += 3) {
+        float d = Dot(axis, &normals[i]);
+        minDot = (d < minDot) ? d : minDot;
+      }
+
+      // A cone of 90 degrees or more faces every way
+      if (minDot > 0) {
+        meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+      }
+    }
+
+  }
+
+  void BuildMeshlets(Mesh3dBuffer& mesh, unsigned int maxVertices, unsigned int maxTriangles) {
+    maxVertices = (maxVertices < 3) ? 3 : maxVertices;
+    maxTriangles = (maxTriangles < 1) ? 1 : maxTriangles;
+
+    mesh.meshlets.clear();
+
+    const std::size_t triangleCount = mesh.indices.size() / 3;
+    if (triangleCount == 0 || mesh.topology != Mesh3d::TRIANGLE_LIST) {
+      return;
+    }
+
+    std::size_t vertexCount = 0;
+    for (std::size_t i = 0; i < triangleCount * 3; i++) {
+      vertexCount = (mesh.indices[i] >= vertexCount) ? mesh.indices[i] + 1 : vertexCount;
+    }
+
+    const TriangleAdjacency adjacency(mesh.indices, vertexCount);
+
+    // The meshlet each vertex was last added to, and each triangle last considered for
+    std::vector<unsigned int> vertexMeshlet(vertexCount, NO_MESHLET);
+    std::vector<unsigned int> candidateMeshlet(triangleCount, NO_MESHLET);
+    std::vector<bool> used(triangleCount, false);
+
+    std::vector<unsigned int> vertices;
+    std::vector<unsigned int> candidates;
+    std::vector<float> points;
+    std::vector<unsigned int> out;
+    out.reserve(mesh.indices.size());
+
+    const Positions positions(mesh);
+    std::size_t cursor = 0;
+
+    for (;;) {
+      while (cursor < triangleCount && used[cursor]) {
+        cursor++;
+      }
+      if (cursor == triangleCount) {
+        break;
+      }
+
+      const unsigned int number = (unsigned int)mesh.meshlets.size();
+      Meshlet meshlet;
+      memset(&meshlet, 0, sizeof(meshlet));
+      meshlet.firstTriangle = (unsigned int)(out.size() / 3);
+      meshlet.coneCutoff = 1;
+
+      vertices.clear();
+      candidates.clear();
+
+      auto newVertices = [&](std::size_t t) {
+        unsigned int count = 0;
+        for (std::size_t c = 0; c < 3; c++) {
+          count += (vertexMeshlet[mesh.indices[t * 3 + c]] != number) ? 1 : 0;
+        }
+        return count;
+      };
+
+      std::size_t next = cursor;
+      while (next != NO_TRIANGLE) {
+        for (std::size_t c = 0; c < 3; c++) {
+          unsigned int v = mesh.indices[next * 3 + c];
+          out.push_back(v);
+
+          if (vertexMeshlet[v] != number) {
+            vertexMeshlet[v] = number;
+            vertices.push_back(v);
+
+            for (std::size_t a = adjacency.first[v]; a < adjacency.first[v + 1]; a++) {
+              unsigned int t = adjacency.triangles[a];
+              if (!used[t] && candidateMeshlet[t] != number) {
+                candidateMeshlet[t] = number;
+                candidates.push_back(t);
+              }
+            }
+          }
+        }
+        used[next] = true;
+
+        if (++meshlet.triangleCount == maxTriangles) {
+          break;
+        }
+
+        // The neighbour bringing in the fewest new vertices, the first in the index
+        // buffer on a tie, dropping neighbours used since they were found
+        next = NO_TRIANGLE;
+        unsigned int fewest = 4;
+        std::size_t kept = 0;
+        for (unsigned int t : candidates) {
+          if (used[t]) {
+            continue;
+          }
+          candidates[kept++] = t;
+
+          unsigned int count = newVertices(t);
+          if (count < fewest || (count == fewest && t < next)) {
+            next = t;
+            fewest = count;
+          }
+        }
+        candidates.resize(kept);
+
+        if (next == NO_TRIANGLE) {
+          while (cursor < triangleCount && used[cursor]) {
+            cursor++;
+          }
+          if (cursor < triangleCount) {
+            next = cursor;
+            fewest = newVertices(cursor);
+          }
+        }
+
+        if (next != NO_TRIANGLE && vertices.size() + fewest > maxVertices) {
+          next = NO_TRIANGLE;
+        }
+      }
+
+      meshlet.vertexCount = (unsigned int)vertices.size();
+
+      bool positioned = positions.count > 0;
+      for (unsigned int v : vertices) {
+        positioned = positioned && v < positions.count;
+      }
+      if (positioned) {
+        // The sphere, from the meshlet's positions gathered together
+        points.clear();
+        for (unsigned int v : vertices) {
+          points.insert(points.end(), positions[v], positions[v] + 3);
+        }
+
+        Bounds bounds;
+        BoundPoints(points.data(), 3, vertices.size(), bounds);
+        for (int c = 0; c < 3; c++) {
+          meshlet.center[c] = bounds.center[c];
+        }
+        meshlet.radius = bounds.radius;
+
+        BoundCone(positions, &out[(std::size_t)meshlet.firstTriangle * 3], meshlet.triangleCount, meshlet);
+      }
+
+      mesh.meshlets.push_back(meshlet);
+    }
+
+    ReplaceTriangles(mesh.indices, out);
+  }
+
+} // namespace james
\ No newline at end of file
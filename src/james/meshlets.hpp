@@ -0,0 +1,23 @@
+#pragma once
+
+#include <james/model-3d.hpp>
+
+namespace james {
+
+  // Limits that suit mesh shaders: NVIDIA suggests 64 vertices and 126 triangles, and
+  // 124 triangles keep a meshlet's 8-bit local indices (3 bytes a triangle) a whole
+  // number of 32-bit words, for renderers that build them from its indices
+  const unsigned int MESHLET_VERTICES = 64;
+  const unsigned int MESHLET_TRIANGLES = 124;
+
+  // Splits the mesh's triangles into meshlets of at most maxVertices distinct vertices
+  // and maxTriangles triangles, and reorders its indices so that each meshlet's
+  // triangles are together, in meshlet order. Each meshlet is grown from one triangle
+  // by adding the neighbouring triangle that brings in the fewest new vertices; one
+  // with no neighbours left takes the next unused triangle in the index buffer, if it
+  // fits. Nothing depends on anything but the mesh, so the result is the same every
+  // time. Vertices themselves are left alone, and strips aren't split.
+  void BuildMeshlets(Mesh3dBuffer& mesh, unsigned int maxVertices = MESHLET_VERTICES,
+    unsigned int maxTriangles = MESHLET_TRIANGLES);
+
+} // namespace james
\ No newline at end of file
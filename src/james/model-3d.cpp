@@ -1,10 +1,367 @@
 #include "model-3d.hpp"
+#include "mapped-file.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <utility>
 
 namespace james {
 
-  Model3d::Model3d(MaterialList&& materials, MeshList&& meshes)
-    : materials_(materials), meshes_(meshes)
+  namespace {
+
+    // The block starts on a cache line, and vertex and index arrays on 16-byte
+    // boundaries for SIMD loads
+    const std::size_t BLOCK_ALIGNMENT = 64;
+    const std::size_t ARRAY_ALIGNMENT = 16;
+
+    // Places things one after another in a model's block. With no block, it only
+    // measures how big the block needs to be.
+    struct Layout {
+      char* base;
+      std::size_t size;
+
+      template <typename T>
+      T* Place(std::size_t count, std::size_t alignment) {
+        size = (size + alignment - 1) & ~(alignment - 1);
+        T* p = base ? reinterpret_cast<T*>(base + size) : nullptr;
+        size += count * sizeof(T);
+        return p;
+      }
+    };
+
+    template <typename T>
+    void Copy(T* to, const std::vector<T>& from) {
+      if (from.size() > 0) {
+        memcpy(to, from.data(), from.size() * sizeof(T));
+      }
+    }
+
+    char* CopyString(char* to, const std::string& from) {
+      memcpy(to, from.c_str(), from.size() + 1);
+      return to;
+    }
+
+    std::size_t AlignUp(std::size_t size, std::size_t alignment) {
+      return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    // How a mesh's vertices are encoded and arranged in the block
+    struct VertexLayout {
+      VertexAttribute position;
+      VertexAttribute normal;
+      VertexAttribute texCoord;
+      std::size_t vertexCount;
+      std::size_t size;   // Bytes of vertex data
+    };
+
+    // Policies for VertexEncoding's layouts. Each places the attributes a mesh has in
+    // its data, setting their offsets and strides and returning the bytes they take.
+    // That's done once per mesh, so that the vertices can then be written straight into
+    // place with nothing left to decide for each one.
+
+    // Floats come first and 16-bit formats after them, so each value is aligned without
+    // gaps between them; the stride is rounded up to keep the next vertex's floats aligned.
+    // That padding is never written, and stays as zeroed with the block.
+    struct InterleavedVertices {
+      static std::size_t Place(VertexAttribute* const* attributes, std::size_t count, std::size_t vertexCount) {
+        unsigned int stride = 0;
+        unsigned int alignment = 1;
+        for (unsigned int boundary = 4; boundary >= 2; boundary /= 2) {
+          for (std::size_t i = 0; i < count; i++) {
+            if (attributes[i]->Alignment() == boundary) {
+              attributes[i]->offset = stride;
+              stride += attributes[i]->Size();
+              alignment = std::max(alignment, boundary);
+            }
+          }
+        }
+        stride = (unsigned int)AlignUp(stride, alignment);
+
+        for (std::size_t i = 0; i < count; i++) {
+          attributes[i]->stride = stride;
+        }
+        return vertexCount * stride;
+      }
+    };
+
+    struct SeparateVertices {
+      static std::size_t Place(VertexAttribute* const* attributes, std::size_t count, std::size_t vertexCount) {
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < count; i++) {
+          size = AlignUp(size, ARRAY_ALIGNMENT);
+          attributes[i]->offset = (unsigned int)size;
+          attributes[i]->stride = attributes[i]->Size();
+          size += vertexCount * attributes[i]->stride;
+        }
+        return size;
+      }
+    };
+
+    // The first attribute (positions) on its own, and the others interleaved after it
+    struct PositionStreamVertices {
+      static std::size_t Place(VertexAttribute* const* attributes, std::size_t count, std::size_t vertexCount) {
+        if (count == 0) {
+          return 0;
+        }
+
+        std::size_t size = InterleavedVertices::Place(attributes, 1, vertexCount);
+        if (count > 1) {
+          size = AlignUp(size, ARRAY_ALIGNMENT);
+
+          std::size_t rest = InterleavedVertices::Place(attributes + 1, count - 1, vertexCount);
+          for (std::size_t i = 1; i < count; i++) {
+            attributes[i]->offset += (unsigned int)size;
+          }
+          size += rest;
+        }
+        return size;
+      }
+    };
+
+    // The attribute at floatOffset in the buffer's vertices, not yet placed, with the
+    // bounds of its values if the format needs them
+    VertexAttribute Describe(const Mesh3dBuffer& buffer, unsigned int floatOffset,
+      unsigned int components, VertexAttribute::Format format
+    ) {
+      VertexAttribute attribute;
+      memset(&attribute, 0, sizeof(attribute));
+      attribute.format = VertexAttribute::NOT_PRESENT;
+
+      if (floatOffset == Mesh3dBuffer::NOT_PRESENT) {
+        return attribute;
+      }
+
+      attribute.format = format;
+      attribute.components = components;
+      for (unsigned int c = 0; c < components; c++) {
+        attribute.scale[c] = 1;
+      }
+
+      if (format == VertexAttribute::UNORM16 && buffer.stride > 0 && buffer.data.size() >= buffer.stride) {
+        float low[3], high[3];
+        for (unsigned int c = 0; c < components; c++) {
+          low[c] = high[c] = buffer.data[floatOffset + c];
+        }
+
+        for (std::size_t v = floatOffset; v < buffer.data.size(); v += buffer.stride) {
+          for (unsigned int c = 0; c < components; c++) {
+            low[c] = std::min(low[c], buffer.data[v + c]);
+            high[c] = std::max(high[c], buffer.data[v + c]);
+          }
+        }
+
+        for (unsigned int c = 0; c < components; c++) {
+          attribute.bias[c] = low[c];
+          attribute.scale[c] = high[c] - low[c];
+        }
+      }
+
+      return attribute;
+    }
+
+    // How far encoding can move a position: UNORM16 rounds each component by up to half
+    // a step, which can take a position out of a sphere that held it. Spheres are widened
+    // by this, both the mesh's and its meshlets'.
+    float PositionError(const VertexAttribute& position) {
+      if (position.format != VertexAttribute::UNORM16) {
+        return 0;
+      }
+
+      float error = 0;
+      for (int c = 0; c < 3; c++) {
+        float halfStep = position.scale[c] / 65535 / 2;
+        error += halfStep * halfStep;
+      }
+      return std::sqrt(error);
+    }
+
+    template <typename Policy>
+    VertexLayout LayOut(const Mesh3dBuffer& buffer, const VertexEncoding& encoding) {
+      // Formats that don't suit an attribute are taken as FLOAT32
+      VertexAttribute::Format position = (encoding.position == VertexAttribute::UNORM16)
+        ? encoding.position : VertexAttribute::FLOAT32;
+      VertexAttribute::Format normal = (encoding.normal == VertexAttribute::OCTAHEDRAL16
+        || encoding.normal == VertexAttribute::OCTAHEDRAL8) ? encoding.normal : VertexAttribute::FLOAT32;
+      VertexAttribute::Format texCoord = (encoding.texCoord == VertexAttribute::HALF16
+        || encoding.texCoord == VertexAttribute::UNORM16) ? encoding.texCoord : VertexAttribute::FLOAT32;
+
+      VertexLayout layout;
+      layout.position = Describe(buffer, buffer.xyzOffset, 3, position);
+      layout.normal = Describe(buffer, buffer.normalsOffset, 3, normal);
+      layout.texCoord = Describe(buffer, buffer.uvOffset, 2, texCoord);
+      layout.vertexCount = (buffer.stride > 0) ? buffer.data.size() / buffer.stride : 0;
+
+      VertexAttribute* present[3];
+      std::size_t count = 0;
+      for (VertexAttribute* attribute : { &layout.position, &layout.normal, &layout.texCoord }) {
+        if (attribute->format != VertexAttribute::NOT_PRESENT) {
+          present[count++] = attribute;
+        }
+      }
+
+      layout.size = Policy::Place(present, count, layout.vertexCount);
+      return layout;
+    }
+
+    template <typename Policy>
+    void LayOutAll(const std::vector<Mesh3dBuffer>& meshes, const VertexEncoding& encoding,
+      std::vector<VertexLayout>& layouts
+    ) {
+      layouts.reserve(meshes.size());
+      for (const Mesh3dBuffer& buffer : meshes) {
+        layouts.push_back(LayOut<Policy>(buffer, encoding));
+      }
+    }
+
+    bool SameAsFloats(const VertexAttribute& attribute, unsigned int floatOffset, unsigned int floatStride) {
+      return attribute.format == VertexAttribute::NOT_PRESENT || (attribute.format == VertexAttribute::FLOAT32
+        && attribute.offset == floatOffset * sizeof(float) && attribute.stride == floatStride * sizeof(float));
+    }
+
+    // Writes each attribute straight into its place, all of one attribute at a time
+    void Encode(const Mesh3dBuffer& buffer, const VertexLayout& layout, unsigned char* out) {
+      // Floats arranged as they are in the buffer are copied straight across
+      if (SameAsFloats(layout.position, buffer.xyzOffset, buffer.stride)
+        && SameAsFloats(layout.normal, buffer.normalsOffset, buffer.stride)
+        && SameAsFloats(layout.texCoord, buffer.uvOffset, buffer.stride)
+      ) {
+        Copy(reinterpret_cast<float*>(out), buffer.data);
+        return;
+      }
+
+      const float* in = buffer.data.data();
+      layout.position.WriteAll(in + buffer.xyzOffset, buffer.stride, layout.vertexCount, out);
+      layout.normal.WriteAll(in + buffer.normalsOffset, buffer.stride, layout.vertexCount, out);
+      layout.texCoord.WriteAll(in + buffer.uvOffset, buffer.stride, layout.vertexCount, out);
+    }
+
+  }
+
+  Model3d::Model3d() : storageSize_(0) {}
+
+  Model3d::~Model3d() {}
+
+  Model3d::Model3d(const std::vector<std::string>& materials, std::vector<Mesh3dBuffer>&& meshes,
+    const VertexEncoding& encoding
+  ) : storageSize_(0)
   {
+    std::vector<VertexLayout> layouts;
+    switch (encoding.layout) {
+    case VertexEncoding::SEPARATE:
+      LayOutAll<SeparateVertices>(meshes, encoding, layouts);
+      break;
+    case VertexEncoding::POSITION_STREAM:
+      LayOutAll<PositionStreamVertices>(meshes, encoding, layouts);
+      break;
+    default:
+      LayOutAll<InterleavedVertices>(meshes, encoding, layouts);
+      break;
+    }
+
+    // The same layout twice: once to measure the block, and once to fill it
+    Layout layout = { nullptr, 0 };
+
+    for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+        if (layout.size == 0) {
+          return;
+        }
+
+        // Zeroed, so that the gaps between arrays and any padding in vertices are the
+        // same every time, in the model and in cache files written from it
+        storage_.reset(new char[layout.size + BLOCK_ALIGNMENT - 1]());
+        storageSize_ = layout.size;
+
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(storage_.get());
+        layout.base = storage_.get() + ((BLOCK_ALIGNMENT - address % BLOCK_ALIGNMENT) % BLOCK_ALIGNMENT);
+        layout.size = 0;
+      }
+
+      Mesh3d* meshes3d = layout.Place<Mesh3d>(meshes.size(), alignof(Mesh3d));
+      Material* materials3d = layout.Place<Material>(materials.size(), alignof(Material));
+
+      for (std::size_t i = 0; i < materials.size(); i++) {
+        char* id = layout.Place<char>(materials[i].size() + 1, 1);
+
+        if (layout.base) {
+          Material material;
+          material.id = CopyString(id, materials[i]);
+          new (materials3d + i) Material(material);
+        }
+      }
+
+      for (std::size_t i = 0; i < meshes.size(); i++) {
+        Mesh3dBuffer& buffer = meshes[i];
+        const VertexLayout& vertexLayout = layouts[i];
+
+        std::size_t dataSize = vertexLayout.size;
+
+        unsigned char* data = layout.Place<unsigned char>(dataSize, ARRAY_ALIGNMENT);
+        unsigned int* indices = layout.Place<unsigned int>(buffer.indices.size(), ARRAY_ALIGNMENT);
+        Meshlet* meshlets = layout.Place<Meshlet>(buffer.meshlets.size(), ARRAY_ALIGNMENT);
+        char* id = layout.Place<char>(buffer.id.size() + 1, 1);
+
+        if (layout.base) {
+          Encode(buffer, vertexLayout, data);
+          Copy(indices, buffer.indices);
+          Copy(meshlets, buffer.meshlets);
+
+          const float error = PositionError(vertexLayout.position);
+          for (std::size_t m = 0; m < buffer.meshlets.size(); m++) {
+            meshlets[m].radius += error;
+          }
+
+          Mesh3d mesh;
+          mesh.position = vertexLayout.position;
+          mesh.normal = vertexLayout.normal;
+          mesh.texCoord = vertexLayout.texCoord;
+          mesh.vertexCount = vertexLayout.vertexCount;
+          mesh.topology = buffer.topology;
+          mesh.bounds = buffer.bounds;
+          mesh.bounds.radius += error;
+          mesh.id = CopyString(id, buffer.id);
+          mesh.material = (buffer.material < materials.size()) ? materials3d + buffer.material : nullptr;
+          mesh.data = Span<const unsigned char>(data, dataSize);
+          mesh.indices = Span<const unsigned int>(indices, buffer.indices.size());
+          mesh.meshlets = Span<const Meshlet>(meshlets, buffer.meshlets.size());
+          new (meshes3d + i) Mesh3d(mesh);
+
+          // Each buffer is released once it's copied, so the meshes aren't all held twice
+          buffer = Mesh3dBuffer();
+        }
+      }
+
+      materials_ = MaterialList(materials3d, materials.size());
+      meshes_ = MeshList(meshes3d, meshes.size());
+    }
+  }
+
+  Model3d::Model3d(Model3d&& other)
+    : storage_(std::move(other.storage_)), storageSize_(other.storageSize_),
+      mapping_(std::move(other.mapping_)), materials_(other.materials_), meshes_(other.meshes_)
+  {
+    other.storageSize_ = 0;
+    other.materials_ = MaterialList();
+    other.meshes_ = MeshList();
+  }
+
+  Model3d& Model3d::operator =(Model3d&& other) {
+    if (this != &other) {
+      storage_ = std::move(other.storage_);
+      storageSize_ = other.storageSize_;
+      mapping_ = std::move(other.mapping_);
+      materials_ = other.materials_;
+      meshes_ = other.meshes_;
+
+      other.storageSize_ = 0;
+      other.materials_ = MaterialList();
+      other.meshes_ = MeshList();
+    }
+    return *this;
   }
 
 } // namespace james
\ No newline at end of file
@@ -1,38 +1,151 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
+#include "bounds.hpp"
+#include "vertex-format.hpp"
 
 namespace james {
 
+  struct MappedFile;
+
+  // A run of elements in a model's storage
+  template <typename T>
+  struct Span {
+    Span() : data_(nullptr), size_(0) {}
+    Span(T* data, std::size_t size) : data_(data), size_(size) {}
+
+    T* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size_; }
+
+    T& operator [](std::size_t i) const { return data_[i]; }
+
+  private:
+    T* data_;
+    std::size_t size_;
+  };
+
   struct Material {
-    std::string id;
+    const char* id;
   };
 
+  // A cluster of a mesh's triangles, for culling: triangleCount triangles from
+  // indices[3 * firstTriangle] on, using vertexCount distinct vertices.
+  //
+  // All of its vertices are in the sphere at center with radius. Its triangles' normals
+  // lie in a cone around coneAxis: it faces away from an eye, and can be culled, if
+  // dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius. The
+  // cutoff is 1, so that the test never passes, if the cone is too wide to cull with.
+  struct Meshlet {
+    unsigned int firstTriangle;
+    unsigned int triangleCount;
+    unsigned int vertexCount;
+    float radius;
+    float center[3];
+    float coneCutoff;
+    float coneAxis[3];
+    float reserved;
+  };
+
+  // Ends one triangle strip in a TRIANGLE_STRIP mesh's indices and starts the next
+  const unsigned int PRIMITIVE_RESTART = (unsigned int)-1;
+
+  // Triangles: each three entries of indices are a triangle's vertices, numbered from 0
+  // to vertexCount - or, for a TRIANGLE_STRIP mesh, strips separated by
+  // PRIMITIVE_RESTART, to draw with primitive restart enabled. The vertices' attributes
+  // are in data, where and in the formats their VertexAttributes say - interleaved or in
+  // arrays of their own, as the model's VertexEncoding has them. Attributes that aren't
+  // present have NOT_PRESENT as their format.
+  //
+  // bounds hold the positions as they were loaded. Positions encoded as UNORM16 stay in
+  // the box, and the sphere is widened by as much as they can move.
   struct Mesh3d {
+    enum Topology {
+      TRIANGLE_LIST,
+      TRIANGLE_STRIP
+    };
+
+    VertexAttribute position;
+    VertexAttribute normal;
+    VertexAttribute texCoord;
+    std::size_t vertexCount;
+    Topology topology;
+    Bounds bounds;
+
+    const char* id;
+    const Material* material;   // Into the model's materials, or null
+    Span<const unsigned char> data;
+    Span<const unsigned int> indices;
+    Span<const Meshlet> meshlets;   // Empty unless the model was loaded with meshlets, and for strips
+  };
+
+  // A Mesh3d while it's being built, before it has a place in a model. Vertices are
+  // interleaved floats; offsets and the stride are counted in floats, and attributes that
+  // aren't present have NOT_PRESENT as their offset.
+  struct Mesh3dBuffer {
     static const unsigned int NOT_PRESENT = (unsigned int)-1;
+    static const std::size_t NO_MATERIAL = (std::size_t)-1;
 
     unsigned int xyzOffset;
     unsigned int uvOffset;
     unsigned int normalsOffset;
     unsigned int stride;
+    Mesh3d::Topology topology;
+    Bounds bounds;   // Of the positions, as BoundPoints gives them
 
     std::string id;
-    Material* material;
+    std::size_t material;   // Index into the model's materials, or NO_MATERIAL
     std::vector<float> data;
+    std::vector<unsigned int> indices;
+    std::vector<Meshlet> meshlets;
   };
 
+  // A model's meshes and materials, with everything they hold - vertices, indices and
+  // strings - in one block of memory, or in the mapping of the cache file it was loaded
+  // from. Models can be moved but not copied.
   struct Model3d {
+    typedef Span<const Material> MaterialList;
+    typedef Span<const Mesh3d> MeshList;
+
+    Model3d();
+    ~Model3d();
+
+    // Packs the buffers into the model, emptying each as it goes, with their vertices
+    // encoded and arranged as encoding says
+    Model3d(const std::vector<std::string>& materials, std::vector<Mesh3dBuffer>&& meshes,
+      const VertexEncoding& encoding = VertexEncoding());
 
-    typedef std::vector<Material> MaterialList;
-    typedef std::vector<Mesh3d> MeshList;
+    Model3d(Model3d&&);
+    Model3d& operator =(Model3d&&);
 
-    Model3d() {}
-    Model3d(MaterialList&&, MeshList&&);
+    Model3d(const Model3d&) = delete;
+    Model3d& operator =(const Model3d&) = delete;
+
+    const MaterialList& Materials() const { return materials_; }
+    const MeshList& Meshes() const { return meshes_; }
+
+    // Bytes in the model's block, or in its cache file
+    std::size_t StorageSize() const { return storageSize_; }
 
   private:
-    std::vector<Material> materials_;
-    std::vector<Mesh3d> meshes_;
+    friend bool LoadModelCache(const char* path, std::uint64_t contentHash, Model3d& model);
+
+    std::unique_ptr<char[]> storage_;
+    std::size_t storageSize_;
+
+    // Only for models loaded from a cache; storage_ then holds just the Mesh3d and
+    // Material arrays
+    std::unique_ptr<MappedFile> mapping_;
+
+    MaterialList materials_;
+    MeshList meshes_;
   };
 
 } // namespace james
\ No newline at end of file
@@ -0,0 +1,463 @@
+#include "model-cache.hpp"
+#include "mapped-file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+namespace james {
+
+  namespace {
+
+    // A cache file is a CacheHeader, the CacheMesh and CacheMaterial records, each
+    // mesh's vertices, indices and meshlets, and then the ids. Offsets are from the start of the
+    // file. Files are written in the machine's own byte order, and ones from a machine
+    // that disagrees are turned away by byteOrder, as are older versions.
+    const char MAGIC[8] = { 'J', 'A', 'M', 'E', 'S', '3', 'D', '\0' };
+    const std::uint32_t VERSION = 8;
+
+    // The revision of the code that builds a model from a document: the listeners in
+    // collada/, triangulation, vertex encoding, OptimizeMesh, BuildMeshlets and
+    // BoundPoints. Files written by another revision are turned away, as they may not
+    // hold the model loading the document gives now. Any change to what that code
+    // produces must bump this, even if the file's layout stays the same.
+    const std::uint32_t LOADER_REVISION = 5;
+    const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+    const std::uint32_t NO_MATERIAL = (std::uint32_t)-1;
+
+    // Vertices, indices and meshlets start on 16-byte boundaries, like they do in a model's block;
+    // the mapping itself starts on a page
+    const std::uint64_t ARRAY_ALIGNMENT = 16;
+    const std::uint64_t RECORD_ALIGNMENT = 8;
+
+    struct CacheHeader {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t byteOrder;
+      std::uint32_t loaderRevision;
+      std::uint32_t reserved;
+      std::uint64_t contentHash;
+      std::uint64_t fileSize;
+      std::uint32_t meshCount;
+      std::uint32_t materialCount;
+      std::uint64_t meshesOffset;
+      std::uint64_t materialsOffset;
+    };
+
+    struct CacheAttribute {
+      std::uint32_t format;
+      std::uint32_t offset;
+      std::uint32_t stride;
+      std::uint32_t components;
+      float bias[3];
+      float scale[3];
+    };
+
+    struct CacheMesh {
+      CacheAttribute position;
+      CacheAttribute normal;
+      CacheAttribute texCoord;
+      std::uint32_t vertexCount;
+      std::uint32_t material;   // Index into the materials, or NO_MATERIAL
+      std::uint32_t topology;
+      std::uint32_t reserved;
+      Bounds bounds;
+      std::uint64_t idOffset;
+      std::uint64_t dataOffset;
+      std::uint64_t dataCount;
+      std::uint64_t indicesOffset;
+      std::uint64_t indicesCount;
+      std::uint64_t meshletsOffset;
+      std::uint64_t meshletsCount;
+    };
+
+    struct CacheMaterial {
+      std::uint64_t idOffset;
+    };
+
+    // No padding anywhere, so that files are the same byte for byte each time
+    static_assert(sizeof(CacheHeader) == 64, "CacheHeader has padding");
+    static_assert(sizeof(CacheMesh) == 232, "CacheMesh has padding");
+    static_assert(sizeof(Bounds) == 40, "Bounds are written as they are");
+    static_assert(sizeof(Meshlet) == 48, "Meshlets are written as they are");
+    static_assert(sizeof(float) == 4 && sizeof(unsigned int) == 4, "Cache files hold 32-bit floats and indices");
+
+    std::uint64_t Place(std::uint64_t& size, std::uint64_t bytes, std::uint64_t alignment) {
+      size = (size + alignment - 1) & ~(alignment - 1);
+      std::uint64_t offset = size;
+      size += bytes;
+      return offset;
+    }
+
+    // Whether count elements at offset lie inside a file of the given size
+    bool Fits(std::uint64_t offset, std::uint64_t count, std::size_t elementSize,
+      std::size_t alignment, std::size_t size)
+    {
+      return offset % alignment == 0 && offset <= size && count <= (size - offset) / elementSize;
+    }
+
+    CacheAttribute ToCache(const VertexAttribute& attribute) {
+      CacheAttribute record;
+      record.format = attribute.format;
+      record.offset = attribute.offset;
+      record.stride = attribute.stride;
+      record.components = attribute.components;
+      for (int c = 0; c < 3; c++) {
+        record.bias[c] = attribute.bias[c];
+        record.scale[c] = attribute.scale[c];
+      }
+      return record;
+    }
+
+    VertexAttribute FromCache(const CacheAttribute& record) {
+      VertexAttribute attribute;
+      attribute.format = (VertexAttribute::Format)record.format;
+      attribute.offset = record.offset;
+      attribute.stride = record.stride;
+      attribute.components = record.components;
+      for (int c = 0; c < 3; c++) {
+        attribute.bias[c] = record.bias[c];
+        attribute.scale[c] = record.scale[c];
+      }
+      return attribute;
+    }
+
+    // Whether an attribute is one there's a format for, and every vertex's value lies
+    // inside the mesh's data
+    bool Fits(const CacheAttribute& record, std::uint32_t vertexCount, std::uint64_t dataSize) {
+      if (record.format == VertexAttribute::NOT_PRESENT || vertexCount == 0) {
+        return true;
+      }
+      if (record.format > VertexAttribute::OCTAHEDRAL8 || record.components < 2 || record.components > 3) {
+        return false;
+      }
+      std::uint64_t end = record.offset + (std::uint64_t)record.stride * (vertexCount - 1) + FromCache(record).Size();
+      return end <= dataSize;
+    }
+
+    bool FitsString(std::uint64_t offset, const char* base, std::size_t size) {
+      return offset < size && memchr(base + offset, '\0', size - (std::size_t)offset) != nullptr;
+    }
+
+    // Writes a file, keeping count of where it's got to
+    struct Writer {
+      std::ofstream out;
+      std::uint64_t offset;
+
+      explicit Writer(const std::string& path)
+        : out(path.c_str(), std::ios::binary | std::ios::trunc), offset(0) {}
+
+      void Write(const void* data, std::uint64_t bytes, std::uint64_t at) {
+        static const char zeroes[ARRAY_ALIGNMENT] = {};
+        while (offset < at) {
+          std::uint64_t pad = std::min<std::uint64_t>(at - offset, sizeof(zeroes));
+          out.write(zeroes, (std::streamsize)pad);
+          offset += pad;
+        }
+
+        if (bytes > 0) {
+          out.write(static_cast<const char*>(data), (std::streamsize)bytes);
+          offset += bytes;
+        }
+      }
+    };
+
+    std::atomic<unsigned int> lastTemporary(0);
+
+    // Where to write a cache file before renaming it to path: beside it, so the rename
+    // stays on one file system, and named for this process and this call, so writers
+    // saving the same model at once don't write over each other's files
+    std::string TemporaryPath(const char* path) {
+#ifdef _WIN32
+      unsigned long process = GetCurrentProcessId();
+#else
+      unsigned long process = (unsigned long)getpid();
+#endif
+      return std::string(path) + "." + std::to_string(process) + "." + std::to_string(++lastTemporary) + ".tmp";
+    }
+
+    bool Replace(const std::string& from, const char* to) {
+#ifdef _WIN32
+      return MoveFileExA(from.c_str(), to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+      return std::rename(from.c_str(), to) == 0;
+#endif
+    }
+
+    // The 64-bit hash from xxHash, which reads four words at a time
+    const std::uint64_t PRIME1 = 11400714785074694791ULL;
+    const std::uint64_t PRIME2 = 14029467366897019727ULL;
+    const std::uint64_t PRIME3 = 1609587929392839161ULL;
+    const std::uint64_t PRIME4 = 9650029242287828579ULL;
+    const std::uint64_t PRIME5 = 2870177450012600261ULL;
+
+    std::uint64_t Rotate(std::uint64_t x, int bits) {
+      return (x << bits) | (x >> (64 - bits));
+    }
+
+    std::uint64_t Read64(const char* p) {
+      std::uint64_t word;
+      memcpy(&word, p, sizeof(word));
+      return word;
+    }
+
+    std::uint64_t Round(std::uint64_t lane, std::uint64_t word) {
+      return Rotate(lane + word * PRIME2, 31) * PRIME1;
+    }
+
+    std::uint64_t Merge(std::uint64_t hash, std::uint64_t lane) {
+      return (hash ^ Round(0, lane)) * PRIME1 + PRIME4;
+    }
+
+  }
+
+  std::uint64_t ContentHash(const char* data, std::size_t length) {
+    const char* p = data;
+    const char* end = data + length;
+    std::uint64_t hash;
+
+    if (length >= 32) {
+      std::uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+      do {
+        lanes[0] = Round(lanes[0], Read64(p));
+        lanes[1] = Round(lanes[1], Read64(p + 8));
+        lanes[2] = Round(lanes[2], Read64(p + 16));
+        lanes[3] = Round(lanes[3], Read64(p + 24));
+        p += 32;
+      } while (end - p >= 32);
+
+      hash = Rotate(lanes[0], 1) + Rotate(lanes[1], 7) + Rotate(lanes[2], 12) + Rotate(lanes[3], 18);
+      for (int i = 0; i < 4; i++) {
+        hash = Merge(hash, lanes[i]);
+      }
+    }
+    else {
+      hash = PRIME5;
+    }
+
+    hash += length;
+
+    for (; end - p >= 8; p += 8) {
+      hash = Rotate(hash ^ Round(0, Read64(p)), 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4) {
+      std::uint32_t word;
+      memcpy(&word, p, sizeof(word));
+      hash = Rotate(hash ^ (word * PRIME1), 23) * PRIME2 + PRIME3;
+      p += 4;
+    }
+    for (; p < end; p++) {
+      hash = Rotate(hash ^ ((unsigned char)*p * PRIME5), 11) * PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+  }
+
+  void SaveModelCache(const Model3d& model, const char* path, std::uint64_t contentHash) {
+    const Model3d::MeshList& meshes = model.Meshes();
+    const Model3d::MaterialList& materials = model.Materials();
+
+    // Lay the file out first, so the records can be written ahead of what they point at
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.loaderRevision = LOADER_REVISION;
+    header.contentHash = contentHash;
+    header.meshCount = (std::uint32_t)meshes.size();
+    header.materialCount = (std::uint32_t)materials.size();
+
+    std::uint64_t size = sizeof(CacheHeader);
+    header.meshesOffset = Place(size, meshes.size() * sizeof(CacheMesh), RECORD_ALIGNMENT);
+    header.materialsOffset = Place(size, materials.size() * sizeof(CacheMaterial), RECORD_ALIGNMENT);
+
+    std::vector<CacheMesh> meshRecords(meshes.size());
+    for (std::size_t i = 0; i < meshes.size(); i++) {
+      const Mesh3d& mesh = meshes[i];
+      CacheMesh& record = meshRecords[i];
+      memset(&record, 0, sizeof(record));
+
+      record.position = ToCache(mesh.position);
+      record.normal = ToCache(mesh.normal);
+      record.texCoord = ToCache(mesh.texCoord);
+      record.vertexCount = (std::uint32_t)mesh.vertexCount;
+      record.topology = mesh.topology;
+      record.bounds = mesh.bounds;
+      record.material = mesh.material ? (std::uint32_t)(mesh.material - materials.data()) : NO_MATERIAL;
+      record.dataCount = mesh.data.size();
+      record.dataOffset = Place(size, mesh.data.size(), ARRAY_ALIGNMENT);
+      record.indicesCount = mesh.indices.size();
+      record.indicesOffset = Place(size, mesh.indices.size() * sizeof(unsigned int), ARRAY_ALIGNMENT);
+      record.meshletsCount = mesh.meshlets.size();
+      record.meshletsOffset = Place(size, mesh.meshlets.size() * sizeof(Meshlet), ARRAY_ALIGNMENT);
+    }
+
+    std::vector<CacheMaterial> materialRecords(materials.size());
+    for (std::size_t i = 0; i < materials.size(); i++) {
+      materialRecords[i].idOffset = Place(size, strlen(materials[i].id) + 1, 1);
+    }
+    for (std::size_t i = 0; i < meshes.size(); i++) {
+      meshRecords[i].idOffset = Place(size, strlen(meshes[i].id) + 1, 1);
+    }
+
+    header.fileSize = size;
+
+    const std::string temporary = TemporaryPath(path);
+    {
+      Writer writer(temporary);
+
+      writer.Write(&header, sizeof(header), 0);
+      writer.Write(meshRecords.data(), meshRecords.size() * sizeof(CacheMesh), header.meshesOffset);
+      writer.Write(materialRecords.data(), materialRecords.size() * sizeof(CacheMaterial), header.materialsOffset);
+
+      for (std::size_t i = 0; i < meshes.size(); i++) {
+        writer.Write(meshes[i].data.data(), meshes[i].data.size(), meshRecords[i].dataOffset);
+        writer.Write(meshes[i].indices.data(), meshes[i].indices.size() * sizeof(unsigned int), meshRecords[i].indicesOffset);
+        writer.Write(meshes[i].meshlets.data(), meshes[i].meshlets.size() * sizeof(Meshlet), meshRecords[i].meshletsOffset);
+      }
+
+      for (std::size_t i = 0; i < materials.size(); i++) {
+        writer.Write(materials[i].id, strlen(materials[i].id) + 1, materialRecords[i].idOffset);
+      }
+      for (std::size_t i = 0; i < meshes.size(); i++) {
+        writer.Write(meshes[i].id, strlen(meshes[i].id) + 1, meshRecords[i].idOffset);
+      }
+
+      writer.out.close();
+      if (!writer.out) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("Unable to write model cache: " + temporary);
+      }
+    }
+
+    if (!Replace(temporary, path)) {
+      std::remove(temporary.c_str());
+      throw std::runtime_error("Unable to write model cache: " + std::string(path));
+    }
+  }
+
+  bool LoadModelCache(const char* path, std::uint64_t contentHash, Model3d& model) {
+    std::unique_ptr<MappedFile> file;
+    try {
+      file.reset(new MappedFile(path));
+    }
+    catch (const std::runtime_error&) {
+      return false;
+    }
+
+    const char* base = file->Data();
+    const std::size_t size = file->Size();
+
+    if (size < sizeof(CacheHeader)) {
+      return false;
+    }
+
+    const CacheHeader& header = *reinterpret_cast<const CacheHeader*>(base);
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+      header.byteOrder != BYTE_ORDER_MARK || header.loaderRevision != LOADER_REVISION ||
+      header.contentHash != contentHash ||
+      header.fileSize != size)
+    {
+      return false;
+    }
+
+    if (!Fits(header.meshesOffset, header.meshCount, sizeof(CacheMesh), RECORD_ALIGNMENT, size) ||
+      !Fits(header.materialsOffset, header.materialCount, sizeof(CacheMaterial), RECORD_ALIGNMENT, size))
+    {
+      return false;
+    }
+
+    const CacheMesh* meshRecords = reinterpret_cast<const CacheMesh*>(base + header.meshesOffset);
+    const CacheMaterial* materialRecords = reinterpret_cast<const CacheMaterial*>(base + header.materialsOffset);
+
+    for (std::uint32_t i = 0; i < header.materialCount; i++) {
+      if (!FitsString(materialRecords[i].idOffset, base, size)) {
+        return false;
+      }
+    }
+
+    for (std::uint32_t i = 0; i < header.meshCount; i++) {
+      const CacheMesh& record = meshRecords[i];
+      if (!FitsString(record.idOffset, base, size) ||
+        !Fits(record.position, record.vertexCount, record.dataCount) ||
+        !Fits(record.normal, record.vertexCount, record.dataCount) ||
+        !Fits(record.texCoord, record.vertexCount, record.dataCount) ||
+        !Fits(record.dataOffset, record.dataCount, 1, ARRAY_ALIGNMENT, size) ||
+        !Fits(record.indicesOffset, record.indicesCount, sizeof(unsigned int), alignof(unsigned int), size) ||
+        !Fits(record.meshletsOffset, record.meshletsCount, sizeof(Meshlet), alignof(Meshlet), size) ||
+        (record.material != NO_MATERIAL && record.material >= header.materialCount) ||
+        record.topology > Mesh3d::TRIANGLE_STRIP)
+      {
+        return false;
+      }
+
+      const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(base + record.meshletsOffset);
+      for (std::uint64_t m = 0; m < record.meshletsCount; m++) {
+        if ((std::uint64_t)meshlets[m].firstTriangle + meshlets[m].triangleCount > record.indicesCount / 3) {
+          return false;
+        }
+      }
+    }
+
+    // Only the arrays that hold pointers are built; everything they point at is the file's
+    const std::size_t meshBytes = header.meshCount * sizeof(Mesh3d);
+    const std::size_t storageSize = meshBytes + header.materialCount * sizeof(Material);
+    static_assert(sizeof(Mesh3d) % alignof(Material) == 0, "Materials follow the meshes");
+
+    std::unique_ptr<char[]> storage(storageSize > 0 ? new char[storageSize] : nullptr);
+    Mesh3d* meshes = reinterpret_cast<Mesh3d*>(storage.get());
+    Material* materials = reinterpret_cast<Material*>(storage.get() + meshBytes);
+
+    for (std::uint32_t i = 0; i < header.materialCount; i++) {
+      Material material;
+      material.id = base + materialRecords[i].idOffset;
+      new (materials + i) Material(material);
+    }
+
+    for (std::uint32_t i = 0; i < header.meshCount; i++) {
+      const CacheMesh& record = meshRecords[i];
+
+      Mesh3d mesh;
+      mesh.position = FromCache(record.position);
+      mesh.normal = FromCache(record.normal);
+      mesh.texCoord = FromCache(record.texCoord);
+      mesh.vertexCount = record.vertexCount;
+      mesh.topology = (Mesh3d::Topology)record.topology;
+      mesh.bounds = record.bounds;
+      mesh.id = base + record.idOffset;
+      mesh.material = (record.material != NO_MATERIAL) ? materials + record.material : nullptr;
+      mesh.data = Span<const unsigned char>(reinterpret_cast<const unsigned char*>(base + record.dataOffset), (std::size_t)record.dataCount);
+      mesh.indices = Span<const unsigned int>(reinterpret_cast<const unsigned int*>(base + record.indicesOffset), (std::size_t)record.indicesCount);
+      mesh.meshlets = Span<const Meshlet>(reinterpret_cast<const Meshlet*>(base + record.meshletsOffset), (std::size_t)record.meshletsCount);
+      new (meshes + i) Mesh3d(mesh);
+    }
+
+    model.storage_ = std::move(storage);
+    model.storageSize_ = size;
+    model.mapping_ = std::move(file);
+    model.materials_ = Model3d::MaterialList(materials, header.materialCount);
+    model.meshes_ = Model3d::MeshList(meshes, header.meshCount);
+    return true;
+  }
+
+} // namespace james
\ No newline at end of file
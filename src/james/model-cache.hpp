@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <james/model-3d.hpp>
+
+namespace james {
+
+  // Hash of a document's bytes, for telling whether a cached model is still the one
+  // the document describes. Not cryptographic.
+  std::uint64_t ContentHash(const char* data, std::size_t length);
+
+  // Writes the model to path as a cache file for the document with contentHash. The
+  // file is written beside path under a name of its own and renamed into place, so
+  // readers never see half of one, even with several writers at once. Throws
+  // std::runtime_error if it can't be written.
+  void SaveModelCache(const Model3d& model, const char* path, std::uint64_t contentHash);
+
+  // Maps a cache file and makes model use it in place: vertices, indices and ids stay
+  // in the mapping, and only the Mesh3d and Material arrays are built. Returns false,
+  // leaving model alone, if there is no file at path or it isn't a cache of this
+  // version, written by this revision of the loader, for the document with contentHash.
+  //
+  // The file's layout is checked, but not the values of its indices.
+  bool LoadModelCache(const char* path, std::uint64_t contentHash, Model3d& model);
+
+} // namespace james
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "optimize-mesh.hpp"
+#include "triangle-adjacency.hpp"
+
+#include <cstring>
+
+namespace james {
+
+  namespace {
+
+    const unsigned int NOT_MAPPED = (unsigned int)-1;
+    const std::size_t NO_VERTEX = (std::size_t)-1;
+
+    // A FIFO cache, kept as the time each vertex last went in: times count misses, so a
+    // vertex has dropped out once cacheSize others have gone in after it
+    VertexCacheStats Measure(const unsigned int* indices, std::size_t count,
+      std::size_t vertexCount, unsigned int cacheSize
+    ) {
+      VertexCacheStats stats;
+      stats.triangles = count / 3;
+      stats.vertices = vertexCount;
+
+      std::vector<std::size_t> cacheTime(vertexCount, 0);
+      std::size_t time = cacheSize + 1;
+
+      for (std::size_t i = 0; i < stats.triangles * 3; i++) {
+        unsigned int v = indices[i];
+        if (v < vertexCount && time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+
+      stats.transforms = time - (cacheSize + 1);
+      return stats;
+    }
+
+  }
+
+  VertexCacheStats MeasureVertexCache(const Mesh3d& mesh, unsigned int cacheSize) {
+    return Measure(mesh.indices.data(), mesh.indices.size(), mesh.vertexCount, cacheSize);
+  }
+
+  VertexCacheStats MeasureVertexCache(const Mesh3dBuffer& mesh, unsigned int cacheSize) {
+    std::size_t vertexCount = (mesh.stride > 0) ? mesh.data.size() / mesh.stride : 0;
+    return Measure(mesh.indices.data(), mesh.indices.size(), vertexCount, cacheSize);
+  }
+
+  void OptimizeVertexCache(std::vector<unsigned int>& indices, std::size_t vertexCount,
+    unsigned int cacheSize
+  ) {
+    const std::size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+      return;
+    }
+
+    // The triangles around each vertex, and how many of them are still to be written
+    const TriangleAdjacency adjacency(indices, vertexCount);
+    std::vector<unsigned int> live(vertexCount);
+    for (std::size_t v = 0; v < vertexCount; v++) {
+      live[v] = (unsigned int)adjacency.Count(v);
+    }
+
+    std::vector<std::size_t> cacheTime(vertexCount, 0);
+    std::size_t time = cacheSize + 1;
+
+    std::vector<bool> written(triangleCount, false);
+    std::vector<unsigned int> deadEnds;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> out;
+    out.reserve(triangleCount * 3);
+
+    // Fan out from one vertex at a time, writing all of its triangles that are left
+    std::size_t fanning = 0;
+    std::size_t cursor = 0;
+
+    while (fanning != NO_VERTEX) {
+      candidates.clear();
+
+      for (std::size_t a = adjacency.first[fanning]; a < adjacency.first[fanning + 1]; a++) {
+        unsigned int t = adjacency.triangles[a];
+        if (written[t]) {
+          continue;
+        }
+
+        for (std::size_t c = 0; c < 3; c++) {
+          unsigned int v = indices[t * 3 + c];
+          out.push_back(v);
+          deadEnds.push_back(v);
+          candidates.push_back(v);
+          live[v]--;
+
+          if (time - cacheTime[v] > cacheSize) {
+            cacheTime[v] = time++;
+          }
+        }
+        written[t] = true;
+      }
+
+      // Next, the vertex just used that's oldest in the cache but still in it after its
+      // own triangles have gone through, or any vertex with triangles left
+      fanning = NO_VERTEX;
+      std::size_t best = 0;
+
+      for (unsigned int v : candidates) {
+        if (live[v] == 0) {
+          continue;
+        }
+
+        std::size_t age = time - cacheTime[v];
+        std::size_t priority = (age + 2 * live[v] <= cacheSize) ? age : 0;
+        if (fanning == NO_VERTEX || priority > best) {
+          fanning = v;
+          best = priority;
+        }
+      }
+
+      if (fanning == NO_VERTEX) {
+        while (!deadEnds.empty()) {
+          unsigned int v = deadEnds.back();
+          deadEnds.pop_back();
+          if (live[v] > 0) {
+            fanning = v;
+            break;
+          }
+        }
+      }
+
+      if (fanning == NO_VERTEX) {
+        while (cursor < vertexCount && live[cursor] == 0) {
+          cursor++;
+        }
+        if (cursor < vertexCount) {
+          fanning = cursor;
+        }
+      }
+    }
+
+    ReplaceTriangles(indices, out);
+  }
+
+  void OptimizeVertexFetch(Mesh3dBuffer& mesh) {
+    if (mesh.stride == 0) {
+      return;
+    }
+
+    const std::size_t vertexCount = mesh.data.size() / mesh.stride;
+
+    std::vector<unsigned int> remap(vertexCount, NOT_MAPPED);
+    unsigned int used = 0;
+    for (unsigned int& i : mesh.indices) {
+      if (remap[i] == NOT_MAPPED) {
+        remap[i] = used++;
+      }
+      i = remap[i];
+    }
+
+    std::vector<float> data((std::size_t)used * mesh.stride);
+    for (std::size_t v = 0; v < vertexCount; v++) {
+      if (remap[v] != NOT_MAPPED) {
+        memcpy(&data[(std::size_t)remap[v] * mesh.stride], &mesh.data[v * mesh.stride], mesh.stride * sizeof(float));
+      }
+    }
+    mesh.data.swap(data);
+  }
+
+  MeshOptimizationReport OptimizeMesh(Mesh3dBuffer& mesh, unsigned int cacheSize) {
+    MeshOptimizationReport report;
+    if (mesh.topology != Mesh3d::TRIANGLE_LIST) {
+      return report;
+    }
+
+    report.before = MeasureVertexCache(mesh, cacheSize);
+
+    if (mesh.stride > 0) {
+      OptimizeVertexCache(mesh.indices, mesh.data.size() / mesh.stride, cacheSize);
+      OptimizeVertexFetch(mesh);
+    }
+
+    report.after = MeasureVertexCache(mesh, cacheSize);
+    return report;
+  }
+
+} // namespace james
\ No newline at end of file
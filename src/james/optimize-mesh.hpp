@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <james/model-3d.hpp>
+
+namespace james {
+
+  // Vertices a GPU's post-transform cache is assumed to hold: a FIFO of 16
+  const unsigned int VERTEX_CACHE_SIZE = 16;
+
+  // How a mesh's triangles, in their order, use the post-transform vertex cache. Stats
+  // of several meshes can be added up.
+  struct VertexCacheStats {
+    std::size_t triangles;
+    std::size_t vertices;
+    std::size_t transforms;   // Cache misses: vertices run through the vertex shader
+
+    VertexCacheStats() : triangles(0), vertices(0), transforms(0) {}
+
+    // Average cache miss ratio: transforms per triangle, from 3 down to about 0.5
+    double Acmr() const { return triangles > 0 ? (double)transforms / triangles : 0; }
+
+    // Average transform to vertex ratio: transforms per vertex, 1 at best
+    double Atvr() const { return vertices > 0 ? (double)transforms / vertices : 0; }
+
+    VertexCacheStats& operator +=(const VertexCacheStats& other) {
+      triangles += other.triangles;
+      vertices += other.vertices;
+      transforms += other.transforms;
+      return *this;
+    }
+  };
+
+  struct MeshOptimizationReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+  };
+
+  // Simulates drawing the mesh, a triangle list, through a FIFO cache of cacheSize vertices
+  VertexCacheStats MeasureVertexCache(const Mesh3d& mesh, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+  VertexCacheStats MeasureVertexCache(const Mesh3dBuffer& mesh, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+  // Reorders triangles so that they reuse vertices still in a cache of cacheSize, with
+  // Tipsify (Sander, Nehab and Barczak, 2007), in time linear in the triangles. Every
+  // index must be below vertexCount.
+  void OptimizeVertexCache(std::vector<unsigned int>& indices, std::size_t vertexCount,
+    unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+  // Renumbers the mesh's vertices in the order its triangles first use them, moving
+  // their data to match, so that drawing reads the vertex data front to back. Vertices
+  // that no triangle uses are dropped.
+  void OptimizeVertexFetch(Mesh3dBuffer& mesh);
+
+  // Both of the above, measuring the mesh before and after. Strips are left as they are.
+  MeshOptimizationReport OptimizeMesh(Mesh3dBuffer& mesh, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+} // namespace james
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "parallel-for.hpp"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace james {
+
+  unsigned int DefaultThreadCount() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return (n > 0) ? n : 1;
+  }
+
+  void ParallelFor(std::size_t count, unsigned int threads, const std::function<void(std::size_t)>& f) {
+    if (threads == 0) {
+      threads = DefaultThreadCount();
+    }
+    if (threads > count) {
+      threads = (unsigned int)count;
+    }
+
+    if (threads <= 1) {
+      for (std::size_t i = 0; i < count; i++) {
+        f(i);
+      }
+      return;
+    }
+
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto work = [&]() {
+      for (;;) {
+        std::size_t i = next++;
+        if (i >= count || failed) {
+          return;
+        }
+
+        try {
+          f(i);
+        }
+        catch (...) {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+          failed = true;
+        }
+      }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned int i = 1; i < threads; i++) {
+      try {
+        workers.push_back(std::thread(work));
+      }
+      catch (const std::system_error&) {
+        // Carry on with the threads we have
+        break;
+      }
+    }
+
+    work();
+
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+} // namespace james
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace james {
+
+  // Number of threads to use when the caller asks for 0 ("one per core")
+  unsigned int DefaultThreadCount();
+
+  // Calls f(i) for every i in [0, count) on up to threads threads (0 means
+  // DefaultThreadCount()), the calling thread being one of them. Items are handed out
+  // in increasing order, so putting the biggest first balances the load. If f throws,
+  // no further items are started and the first exception is rethrown once all the
+  // threads have stopped.
+  void ParallelFor(std::size_t count, unsigned int threads, const std::function<void(std::size_t)>& f);
+
+} // namespace james
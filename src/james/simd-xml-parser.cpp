@@ -0,0 +1,769 @@
+#include <james/simd-xml-parser.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define SIMD_XML_SSE2 1
+#  include <emmintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  endif
+#endif
+
+namespace james {
+
+  namespace {
+
+#ifdef SIMD_XML_SSE2
+    inline unsigned int LowestBit(unsigned int mask) {
+#  ifdef _MSC_VER
+      unsigned long i;
+      _BitScanForward(&i, mask);
+      return (unsigned int)i;
+#  else
+      return (unsigned int)__builtin_ctz(mask);
+#  endif
+    }
+#endif
+
+    // First c in [p, end), or end. The CRT's memchr is already vectorised.
+    inline const char* Find(const char* p, const char* end, char c) {
+      const void* found = memchr(p, c, (size_t)(end - p));
+      return found ? static_cast<const char*>(found) : end;
+    }
+
+    // First of a, b or c in [p, end), or end
+    inline const char* FindAny(const char* p, const char* end, char a, char b, char c) {
+#ifdef SIMD_XML_SSE2
+      const __m128i va = _mm_set1_epi8(a);
+      const __m128i vb = _mm_set1_epi8(b);
+      const __m128i vc = _mm_set1_epi8(c);
+
+      for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hits = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(block, va), _mm_cmpeq_epi8(block, vb)),
+          _mm_cmpeq_epi8(block, vc));
+
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) {
+          return p + LowestBit(mask);
+        }
+      }
+#endif
+      for (; p < end; p++) {
+        if (*p == a || *p == b || *p == c) {
+          return p;
+        }
+      }
+      return end;
+    }
+
+    // First occurrence of s (of length n) in [p, end), or end
+    inline const char* FindString(const char* p, const char* end, const char* s, size_t n) {
+      for (;;) {
+        p = Find(p, end, s[0]);
+        if ((size_t)(end - p) < n) {
+          return end;
+        }
+        if (memcmp(p, s, n) == 0) {
+          return p;
+        }
+        p++;
+      }
+    }
+
+    template <size_t N>
+    inline bool StartsWith(const char* p, const char* end, const char (&s)[N]) {
+      return (size_t)(end - p) >= N - 1 && memcmp(p, s, N - 1) == 0;
+    }
+
+    inline bool IsSpace(char c) {
+      return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+    }
+
+    inline const char* SkipSpace(const char* p, const char* end) {
+      while (p < end && IsSpace(*p)) {
+        p++;
+      }
+      return p;
+    }
+
+    inline bool IsNameEnd(char c) {
+      switch (c) {
+      case ' ': case '\n': case '\t': case '\r':
+      case '>': case '/': case '=': case '?':
+      case '<': case '"': case '\'':
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    inline const char* ScanName(const char* p, const char* end) {
+      while (p < end && !IsNameEnd(*p)) {
+        p++;
+      }
+      return p;
+    }
+
+    inline bool IsNameStart(char c) {
+      return !(c >= '0' && c <= '9') && c != '-' && c != '.' && !IsNameEnd(c) && c != '&';
+    }
+
+    void AppendUtf8(std::string& out, unsigned long c) {
+      if (c < 0x80) {
+        out += (char)c;
+      }
+      else if (c < 0x800) {
+        out += (char)(0xC0 | (c >> 6));
+        out += (char)(0x80 | (c & 0x3F));
+      }
+      else if (c < 0x10000) {
+        out += (char)(0xE0 | (c >> 12));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+      }
+      else {
+        out += (char)(0xF0 | (c >> 18));
+        out += (char)(0x80 | ((c >> 12) & 0x3F));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+      }
+    }
+
+    bool EqualsIgnoreCase(const char* p, const char* end, const char* s) {
+      for (; p < end && *s; p++, s++) {
+        char c = (*p >= 'a' && *p <= 'z') ? (char)(*p - 'a' + 'A') : *p;
+        if (c != *s) {
+          return false;
+        }
+      }
+      return p == end && *s == 0;
+    }
+
+    // Longest reference worth looking for a ';' in, e.g. "&#x0010FFFF;"
+    const size_t MAX_REFERENCE_LENGTH = 32;
+
+  }
+
+  //
+  // NameTable
+  //
+
+  SimdXmlParser::NameTable::NameTable()
+    : entries_(64), count_(0)
+  {}
+
+  const char* SimdXmlParser::NameTable::Intern(const char* name, size_t length) {
+    // FNV-1a
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+      hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+
+    size_t mask = entries_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      Entry& entry = entries_[i];
+
+      if (!entry.name) {
+        storage_.push_back(std::string(name, length));
+        const char* interned = storage_.back().c_str();
+
+        entry.name = interned;
+        entry.length = length;
+        if (++count_ * 2 > entries_.size()) {
+          Grow();
+        }
+        return interned;
+      }
+
+      if (entry.length == length && memcmp(entry.name, name, length) == 0) {
+        return entry.name;
+      }
+    }
+  }
+
+  void SimdXmlParser::NameTable::Grow() {
+    std::vector<Entry> old(entries_.size() * 2);
+    old.swap(entries_);
+
+    size_t mask = entries_.size() - 1;
+    for (const Entry& entry : old) {
+      if (!entry.name) {
+        continue;
+      }
+
+      size_t hash = 2166136261u;
+      for (size_t i = 0; i < entry.length; i++) {
+        hash = (hash ^ (unsigned char)entry.name[i]) * 16777619u;
+      }
+
+      size_t i = hash & mask;
+      while (entries_[i].name) {
+        i = (i + 1) & mask;
+      }
+      entries_[i] = entry;
+    }
+  }
+
+  //
+  // SimdXmlParser
+  //
+
+  SimdXmlParser::SimdXmlParser(ExpatParser::XMLConsumer& consumer, RegisteredHandlers handlers)
+    : consumer_(consumer), handlers_(handlers), done_(false), begin_(nullptr), end_(nullptr)
+  {
+    if (handlers & DEFAULT_HANDLER) {
+      throw Unsupported("SimdXmlParser doesn't support the default handler");
+    }
+  }
+
+  bool SimdXmlParser::Accelerated() {
+#ifdef SIMD_XML_SSE2
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void SimdXmlParser::Parse(const char* data, size_t length) {
+    assert(!done_);
+
+    done_ = true;
+    begin_ = data;
+    end_ = data + length;
+
+    const char* p = ParseProlog(data);
+    p = ParseContent(p);
+    ParseEpilog(p);
+  }
+
+  void SimdXmlParser::Fail(const char* msg, const char* at) const {
+    throw Exception(msg, 1 + (size_t)std::count(begin_, at, '\n'));
+  }
+
+  void SimdXmlParser::CharacterData(const char* s, size_t length) {
+    while (length > INT_MAX) {
+      consumer_.CharacterData(s, INT_MAX);
+      s += INT_MAX;
+      length -= INT_MAX;
+    }
+    consumer_.CharacterData(s, (int)length);
+  }
+
+  const char* SimdXmlParser::ParseProlog(const char* p) {
+    if (end_ - p >= 3 && (unsigned char)p[0] == 0xEF && (unsigned char)p[1] == 0xBB && (unsigned char)p[2] == 0xBF) {
+      p += 3;
+    }
+    else if (end_ - p >= 2 && (((unsigned char)p[0] == 0xFE && (unsigned char)p[1] == 0xFF)
+      || ((unsigned char)p[0] == 0xFF && (unsigned char)p[1] == 0xFE))
+    ) {
+      throw Unsupported("SimdXmlParser only reads UTF-8");
+    }
+
+    if (StartsWith(p, end_, "<?xml") && end_ - p > 5 && IsSpace(p[5])) {
+      p = ParseDeclaration(p);
+    }
+
+    for (;;) {
+      p = SkipSpace(p, end_);
+
+      if (p == end_) {
+        Fail("no element found", p);
+      }
+      else if (*p != '<') {
+        Fail("syntax error", p);
+      }
+      else if (StartsWith(p, end_, "<!--")) {
+        p = ParseComment(p);
+      }
+      else if (StartsWith(p, end_, "<!DOCTYPE")) {
+        throw Unsupported("SimdXmlParser doesn't read documents with a DOCTYPE");
+      }
+      else if (StartsWith(p, end_, "<?")) {
+        p = ParsePI(p);
+      }
+      else if (StartsWith(p, end_, "<!")) {
+        Fail("syntax error", p);
+      }
+      else {
+        return p;
+      }
+    }
+  }
+
+  const char* SimdXmlParser::ParseDeclaration(const char* p) {
+    const char* close = FindString(p, end_, "?>", 2);
+    if (close == end_) {
+      Fail("unclosed token", p);
+    }
+
+    static const char ENCODING[] = "encoding";
+    const char* encoding = FindString(p, close, ENCODING, sizeof(ENCODING) - 1);
+    if (encoding != close) {
+      const char* value = SkipSpace(encoding + sizeof(ENCODING) - 1, close);
+      if (value == close || *value != '=') {
+        Fail("XML declaration not well-formed", encoding);
+      }
+
+      value = SkipSpace(value + 1, close);
+      if (value == close || (*value != '"' && *value != '\'')) {
+        Fail("XML declaration not well-formed", encoding);
+      }
+
+      const char* valueEnd = Find(value + 1, close, *value);
+      if (valueEnd == close) {
+        Fail("XML declaration not well-formed", encoding);
+      }
+
+      if (!EqualsIgnoreCase(value + 1, valueEnd, "UTF-8") && !EqualsIgnoreCase(value + 1, valueEnd, "US-ASCII")) {
+        throw Unsupported("SimdXmlParser only reads UTF-8");
+      }
+    }
+
+    return close + 2;
+  }
+
+  const char* SimdXmlParser::ParseContent(const char* p) {
+    p = ParseStartTag(p);
+
+    while (!openElements_.empty()) {
+      // Text up to the next markup, reference or carriage return goes to the consumer
+      // as it is
+      const char* text = p;
+      p = FindAny(p, end_, '<', '&', '\r');
+      if (p != text) {
+        CharacterData(text, (size_t)(p - text));
+      }
+
+      if (p == end_) {
+        Fail("no element found", p);
+      }
+
+      if (*p == '&') {
+        scratch_.clear();
+        p = ParseReference(p, end_, scratch_);
+        CharacterData(scratch_.data(), scratch_.size());
+      }
+      else if (*p == '\r') {
+        // Line ends are normalised to \n, as expat does
+        CharacterData("\n", 1);
+        p += (end_ - p > 1 && p[1] == '\n') ? 2 : 1;
+      }
+      else if (end_ - p < 2) {
+        Fail("unclosed token", p);
+      }
+      else if (p[1] == '/') {
+        p = ParseEndTag(p);
+      }
+      else if (p[1] == '!') {
+        if (StartsWith(p, end_, "<!--")) {
+          p = ParseComment(p);
+        }
+        else if (StartsWith(p, end_, "<![CDATA[")) {
+          p = ParseCData(p);
+        }
+        else {
+          Fail("syntax error", p);
+        }
+      }
+      else if (p[1] == '?') {
+        p = ParsePI(p);
+      }
+      else {
+        p = ParseStartTag(p);
+      }
+    }
+
+    return p;
+  }
+
+  const char* SimdXmlParser::ParseEpilog(const char* p) {
+    for (;;) {
+      p = SkipSpace(p, end_);
+
+      if (p == end_) {
+        return p;
+      }
+      else if (StartsWith(p, end_, "<!--")) {
+        p = ParseComment(p);
+      }
+      else if (StartsWith(p, end_, "<?")) {
+        p = ParsePI(p);
+      }
+      else {
+        Fail("junk after document element", p);
+      }
+    }
+  }
+
+  const char* SimdXmlParser::ParseStartTag(const char* p) {
+    const char* tagStart = p++;
+
+    const char* nameStart = p;
+    p = ScanName(p, end_);
+    if (p == nameStart || !IsNameStart(*nameStart)) {
+      Fail("not well-formed (invalid token)", nameStart);
+    }
+
+    size_t nameLength = (size_t)(p - nameStart);
+    const char* name = names_.Intern(nameStart, nameLength);
+
+    // Values are decoded into attValues_ first, and atts_ pointed at them once it has
+    // stopped growing
+    atts_.clear();
+    attValueOffsets_.clear();
+    attValues_.clear();
+
+    bool empty = false;
+    for (;;) {
+      const char* beforeSpace = p;
+      p = SkipSpace(p, end_);
+
+      if (p == end_) {
+        Fail("unclosed token", tagStart);
+      }
+      if (*p == '>') {
+        p++;
+        break;
+      }
+      if (*p == '/') {
+        if (end_ - p < 2 || p[1] != '>') {
+          Fail("not well-formed (invalid token)", p);
+        }
+        p += 2;
+        empty = true;
+        break;
+      }
+      if (p == beforeSpace) {
+        Fail("not well-formed (invalid token)", p);
+      }
+
+      const char* attStart = p;
+      p = ScanName(p, end_);
+      if (p == attStart || !IsNameStart(*attStart)) {
+        Fail("not well-formed (invalid token)", attStart);
+      }
+
+      const char* attName = names_.Intern(attStart, (size_t)(p - attStart));
+      for (size_t i = 0; i < atts_.size(); i += 2) {
+        if (atts_[i] == attName) {
+          Fail("duplicate attribute", attStart);
+        }
+      }
+
+      p = SkipSpace(p, end_);
+      if (p == end_ || *p != '=') {
+        Fail("not well-formed (invalid token)", p);
+      }
+
+      p = SkipSpace(p + 1, end_);
+      if (p == end_ || (*p != '"' && *p != '\'')) {
+        Fail("not well-formed (invalid token)", p);
+      }
+
+      const char* valueEnd = Find(p + 1, end_, *p);
+      if (valueEnd == end_) {
+        Fail("unclosed token", tagStart);
+      }
+
+      attValueOffsets_.push_back(attValues_.size());
+      p = ParseAttributeValue(p + 1, valueEnd, attValues_);
+      attValues_ += '\0';
+
+      atts_.push_back(attName);
+      atts_.push_back(nullptr);
+    }
+
+    for (size_t i = 0; i < attValueOffsets_.size(); i++) {
+      atts_[2 * i + 1] = attValues_.data() + attValueOffsets_[i];
+    }
+    atts_.push_back(nullptr);
+
+    consumer_.skipRequested_ = false;
+    consumer_.StartElement(name, &atts_[0]);
+
+    if (empty) {
+      if (consumer_.skipRequested_) {
+        // Counted as expat counts it: the whole tag
+        skipped_.elements++;
+        skipped_.bytes += (unsigned long long)(p - tagStart);
+      }
+      consumer_.EndElement(name);
+    }
+    else if (consumer_.skipRequested_) {
+      p = SkipContent(tagStart, p, name, nameLength);
+      consumer_.EndElement(name);
+    }
+    else {
+      openElements_.push_back(std::make_pair(name, nameLength));
+    }
+
+    return p;
+  }
+
+  const char* SimdXmlParser::ParseAttributeValue(const char* p, const char* valueEnd, std::string& out) {
+    // Whitespace characters become spaces and references are replaced, as for an
+    // attribute declared CDATA (or not declared at all)
+    while (p < valueEnd) {
+      const char* run = p;
+      while (p < valueEnd && *p != '&' && *p != '<' && *p != '\t' && *p != '\n' && *p != '\r') {
+        p++;
+      }
+      out.append(run, p);
+
+      if (p == valueEnd) {
+        break;
+      }
+
+      switch (*p) {
+      case '&':
+        p = ParseReference(p, valueEnd, out);
+        break;
+      case '<':
+        Fail("not well-formed (invalid token)", p);
+      case '\r':
+        out += ' ';
+        p += (valueEnd - p > 1 && p[1] == '\n') ? 2 : 1;
+        break;
+      default:
+        out += ' ';
+        p++;
+        break;
+      }
+    }
+
+    return valueEnd + 1;
+  }
+
+  const char* SimdXmlParser::ParseEndTag(const char* p) {
+    const char* tagStart = p;
+    p += 2;
+
+    const char* nameStart = p;
+    p = ScanName(p, end_);
+    size_t nameLength = (size_t)(p - nameStart);
+
+    const std::pair<const char*, size_t>& open = openElements_.back();
+    if (nameLength != open.second || memcmp(nameStart, open.first, nameLength) != 0) {
+      Fail("mismatched tag", tagStart);
+    }
+
+    p = SkipSpace(p, end_);
+    if (p == end_ || *p != '>') {
+      Fail("not well-formed (invalid token)", p);
+    }
+
+    const char* name = open.first;
+    openElements_.pop_back();
+    consumer_.EndElement(name);
+
+    return p + 1;
+  }
+
+  const char* SimdXmlParser::ParseComment(const char* p) {
+    const char* start = p + 4;
+    const char* close = FindString(start, end_, "-->", 3);
+    if (close == end_) {
+      Fail("unclosed token", p);
+    }
+
+    if (handlers_ & COMMENT_HANDLER) {
+      scratch_.assign(start, close);
+      consumer_.Comment(scratch_.c_str());
+    }
+
+    return close + 3;
+  }
+
+  const char* SimdXmlParser::ParseCData(const char* p) {
+    const char* start = p + 9;
+    const char* close = FindString(start, end_, "]]>", 3);
+    if (close == end_) {
+      Fail("unclosed CDATA section", p);
+    }
+
+    if (handlers_ & CDATA_HANDLER) {
+      consumer_.StartCData();
+    }
+
+    while (start < close) {
+      const char* cr = Find(start, close, '\r');
+      if (cr != start) {
+        CharacterData(start, (size_t)(cr - start));
+      }
+      if (cr == close) {
+        break;
+      }
+
+      CharacterData("\n", 1);
+      start = cr + ((close - cr > 1 && cr[1] == '\n') ? 2 : 1);
+    }
+
+    if (handlers_ & CDATA_HANDLER) {
+      consumer_.EndCData();
+    }
+
+    return close + 3;
+  }
+
+  const char* SimdXmlParser::ParsePI(const char* p) {
+    const char* targetStart = p + 2;
+    const char* targetEnd = ScanName(targetStart, end_);
+    if (targetEnd == targetStart || !IsNameStart(*targetStart)) {
+      Fail("not well-formed (invalid token)", targetStart);
+    }
+    if (EqualsIgnoreCase(targetStart, targetEnd, "XML")) {
+      Fail("XML or text declaration not at start of entity", p);
+    }
+
+    const char* close = FindString(targetEnd, end_, "?>", 2);
+    if (close == end_) {
+      Fail("unclosed token", p);
+    }
+
+    if (handlers_ & PI_HANDLER) {
+      const char* data = SkipSpace(targetEnd, close);
+
+      scratch_.assign(targetStart, targetEnd);
+      scratch_ += '\0';
+      scratch_.append(data, close);
+
+      consumer_.ProcessingInstruction(scratch_.c_str(), scratch_.c_str() + (targetEnd - targetStart) + 1);
+    }
+
+    return close + 2;
+  }
+
+  const char* SimdXmlParser::ParseReference(const char* p, const char* limit, std::string& out) {
+    const char* start = p + 1;
+    const char* searchEnd = ((size_t)(limit - start) > MAX_REFERENCE_LENGTH) ? start + MAX_REFERENCE_LENGTH : limit;
+    const char* semicolon = Find(start, searchEnd, ';');
+    if (semicolon == searchEnd || semicolon == start) {
+      Fail("not well-formed (invalid token)", p);
+    }
+
+    size_t length = (size_t)(semicolon - start);
+
+    if (*start == '#') {
+      bool hex = length > 1 && start[1] == 'x';
+      const char* digits = start + (hex ? 2 : 1);
+      if (digits == semicolon) {
+        Fail("not well-formed (invalid token)", p);
+      }
+
+      unsigned long c = 0;
+      for (const char* d = digits; d < semicolon; d++) {
+        int value;
+        if (*d >= '0' && *d <= '9') { value = *d - '0'; }
+        else if (hex && *d >= 'a' && *d <= 'f') { value = *d - 'a' + 10; }
+        else if (hex && *d >= 'A' && *d <= 'F') { value = *d - 'A' + 10; }
+        else { Fail("not well-formed (invalid token)", p); }
+
+        c = c * (hex ? 16 : 10) + value;
+        if (c > 0x10FFFF) {
+          Fail("reference to invalid character number", p);
+        }
+      }
+
+      if (c == 0 || (c >= 0xD800 && c <= 0xDFFF) || c == 0xFFFE || c == 0xFFFF) {
+        Fail("reference to invalid character number", p);
+      }
+      AppendUtf8(out, c);
+    }
+    else if (length == 2 && start[0] == 'l' && start[1] == 't') {
+      out += '<';
+    }
+    else if (length == 2 && start[0] == 'g' && start[1] == 't') {
+      out += '>';
+    }
+    else if (length == 3 && memcmp(start, "amp", 3) == 0) {
+      out += '&';
+    }
+    else if (length == 4 && memcmp(start, "apos", 4) == 0) {
+      out += '\'';
+    }
+    else if (length == 4 && memcmp(start, "quot", 4) == 0) {
+      out += '"';
+    }
+    else {
+      // Only defined by a DTD (which would have made this Unsupported already), so
+      // leave the error to expat
+      throw Unsupported("SimdXmlParser only reads the predefined entities");
+    }
+
+    return semicolon + 1;
+  }
+
+  const char* SimdXmlParser::SkipContent(const char* tagStart, const char* p, const char* name, size_t length) {
+    // Only markup boundaries are looked for: text, attributes and the names of nested
+    // elements are not examined
+    int depth = 1;
+
+    for (;;) {
+      p = Find(p, end_, '<');
+      if (end_ - p < 2) {
+        Fail("no element found", p);
+      }
+
+      if (p[1] == '/') {
+        if (--depth == 0) {
+          const char* nameEnd = ScanName(p + 2, end_);
+          if ((size_t)(nameEnd - (p + 2)) != length || memcmp(p + 2, name, length) != 0) {
+            Fail("mismatched tag", p);
+          }
+
+          skipped_.elements++;
+          skipped_.bytes += (unsigned long long)(p - tagStart);
+
+          const char* close = SkipSpace(nameEnd, end_);
+          if (close == end_ || *close != '>') {
+            Fail("not well-formed (invalid token)", close);
+          }
+          return close + 1;
+        }
+
+        p = Find(p, end_, '>');
+      }
+      else if (StartsWith(p, end_, "<!--")) {
+        p = FindString(p + 4, end_, "-->", 3);
+      }
+      else if (StartsWith(p, end_, "<![CDATA[")) {
+        p = FindString(p + 9, end_, "]]>", 3);
+      }
+      else if (p[1] == '?') {
+        p = FindString(p + 2, end_, "?>", 2);
+      }
+      else {
+        // A start tag; attribute values may contain '>'
+        const char* q = p + 1;
+        for (;;) {
+          q = FindAny(q, end_, '>', '"', '\'');
+          if (q == end_ || *q == '>') {
+            break;
+          }
+          q = Find(q + 1, end_, *q);
+          if (q == end_) {
+            break;
+          }
+          q++;
+        }
+
+        if (q != end_ && q[-1] != '/') {
+          depth++;
+        }
+        p = q;
+      }
+
+      if (p == end_) {
+        Fail("unclosed token", tagStart);
+      }
+      p++;
+    }
+  }
+
+} // james
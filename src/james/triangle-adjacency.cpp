@@ -0,0 +1,29 @@
+#include "triangle-adjacency.hpp"
+
+namespace james {
+
+  TriangleAdjacency::TriangleAdjacency(const std::vector<unsigned int>& indices, std::size_t vertexCount)
+    : first(vertexCount + 1, 0)
+  {
+    const std::size_t cornerCount = indices.size() / 3 * 3;
+
+    for (std::size_t i = 0; i < cornerCount; i++) {
+      first[indices[i] + 1]++;
+    }
+    for (std::size_t v = 0; v < vertexCount; v++) {
+      first[v + 1] += first[v];
+    }
+
+    triangles.resize(cornerCount);
+    std::vector<std::size_t> next(first.begin(), first.end() - 1);
+    for (std::size_t i = 0; i < cornerCount; i++) {
+      triangles[next[indices[i]]++] = (unsigned int)(i / 3);
+    }
+  }
+
+  void ReplaceTriangles(std::vector<unsigned int>& indices, std::vector<unsigned int>& reordered) {
+    reordered.insert(reordered.end(), indices.begin() + indices.size() / 3 * 3, indices.end());
+    indices.swap(reordered);
+  }
+
+} // namespace james
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace james {
+
+  // The triangles around each vertex of a triangle list: those using vertex v are
+  // triangles[first[v]] to triangles[first[v + 1] - 1], in index buffer order, a
+  // triangle using v twice being listed twice. Every index must be below vertexCount;
+  // indices past the last whole triangle are left out.
+  struct TriangleAdjacency {
+    std::vector<std::size_t> first;
+    std::vector<unsigned int> triangles;
+
+    TriangleAdjacency(const std::vector<unsigned int>& indices, std::size_t vertexCount);
+
+    // Triangles around v
+    std::size_t Count(std::size_t v) const { return first[v + 1] - first[v]; }
+  };
+
+  // Replaces indices with reordered, the whole triangles of indices in a new order.
+  // Whatever is past the last whole triangle stays at the end.
+  void ReplaceTriangles(std::vector<unsigned int>& indices, std::vector<unsigned int>& reordered);
+
+} // namespace james
\ No newline at end of file
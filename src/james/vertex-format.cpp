@@ -0,0 +1,250 @@
+#include "vertex-format.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace james {
+
+  namespace {
+
+    const float UNORM16_MAX = 65535.0f;
+    const float SNORM16_MAX = 32767.0f;
+    const float SNORM8_MAX = 127.0f;
+
+    std::uint32_t Bits(float f) {
+      std::uint32_t u;
+      memcpy(&u, &f, sizeof(u));
+      return u;
+    }
+
+    float FromBits(std::uint32_t u) {
+      float f;
+      memcpy(&f, &u, sizeof(f));
+      return f;
+    }
+
+    // Rounds to the nearest half, ties to even; too big becomes infinity
+    std::uint16_t ToHalf(float f) {
+      std::uint32_t u = Bits(f);
+      const std::uint32_t sign = u & 0x80000000u;
+      u ^= sign;
+
+      std::uint32_t half;
+      if (u >= (143u << 23)) {
+        half = (u > (255u << 23)) ? 0x7e00 : 0x7c00;
+      }
+      else if (u < (113u << 23)) {
+        // Too small to be normal: adding 0.5 leaves the denormal, rounded, in the low bits
+        half = Bits(FromBits(u) + 0.5f) - Bits(0.5f);
+      }
+      else {
+        std::uint32_t odd = (u >> 13) & 1;
+        half = (u + 0xc8000fffu + odd) >> 13;
+      }
+
+      return (std::uint16_t)(half | (sign >> 16));
+    }
+
+    float FromHalf(std::uint16_t half) {
+      const std::uint32_t sign = (std::uint32_t)(half & 0x8000) << 16;
+      const std::uint32_t exponent = (half >> 10) & 0x1f;
+      const std::uint32_t mantissa = half & 0x3ff;
+
+      if (exponent == 0) {
+        float f = mantissa * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+      }
+      if (exponent == 31) {
+        return FromBits(sign | 0x7f800000u | (mantissa << 13));
+      }
+      return FromBits(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    float SignOf(float f) {
+      return (f < 0) ? -1.0f : 1.0f;
+    }
+
+    float Clamp(float f, float low, float high) {
+      return (f < low) ? low : (f > high ? high : f);
+    }
+
+    template <typename T>
+    void Store(unsigned char* to, T value) {
+      memcpy(to, &value, sizeof(value));
+    }
+
+    template <typename T>
+    T Load(const unsigned char* from) {
+      T value;
+      memcpy(&value, from, sizeof(value));
+      return value;
+    }
+
+    // To the octahedron |x| + |y| + |z| = 1, with the lower half folded over the upper
+    void ToOctahedron(const float* n, float& u, float& v) {
+      float length = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+      if (length == 0) {
+        u = v = 0;
+        return;
+      }
+
+      u = n[0] / length;
+      v = n[1] / length;
+      if (n[2] < 0) {
+        float foldedU = (1 - std::fabs(v)) * SignOf(u);
+        v = (1 - std::fabs(u)) * SignOf(v);
+        u = foldedU;
+      }
+    }
+
+    void FromOctahedron(float u, float v, float* n) {
+      n[0] = u;
+      n[1] = v;
+      n[2] = 1 - std::fabs(u) - std::fabs(v);
+      if (n[2] < 0) {
+        n[0] = (1 - std::fabs(v)) * SignOf(u);
+        n[1] = (1 - std::fabs(u)) * SignOf(v);
+      }
+
+      float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int c = 0; c < 3; c++) {
+        n[c] /= length;
+      }
+    }
+
+    // Encoders for each format, from components floats to one value
+
+    void EncodeFloat32(const VertexAttribute& attribute, const float* in, unsigned char* out) {
+      memcpy(out, in, attribute.components * sizeof(float));
+    }
+
+    void EncodeHalf16(const VertexAttribute& attribute, const float* in, unsigned char* out) {
+      for (unsigned int c = 0; c < attribute.components; c++) {
+        Store(out + 2 * c, ToHalf(in[c]));
+      }
+    }
+
+    void EncodeUnorm16(const VertexAttribute& attribute, const float* in, unsigned char* out) {
+      for (unsigned int c = 0; c < attribute.components; c++) {
+        float t = (attribute.scale[c] > 0) ? Clamp((in[c] - attribute.bias[c]) / attribute.scale[c], 0, 1) : 0;
+        Store(out + 2 * c, (std::uint16_t)(t * UNORM16_MAX + 0.5f));
+      }
+    }
+
+    void EncodeOctahedral16(const VertexAttribute&, const float* in, unsigned char* out) {
+      float u, v;
+      ToOctahedron(in, u, v);
+      Store(out, (std::int16_t)std::lround(Clamp(u, -1, 1) * SNORM16_MAX));
+      Store(out + 2, (std::int16_t)std::lround(Clamp(v, -1, 1) * SNORM16_MAX));
+    }
+
+    void EncodeOctahedral8(const VertexAttribute&, const float* in, unsigned char* out) {
+      float u, v;
+      ToOctahedron(in, u, v);
+      Store(out, (std::int8_t)std::lround(Clamp(u, -1, 1) * SNORM8_MAX));
+      Store(out + 1, (std::int8_t)std::lround(Clamp(v, -1, 1) * SNORM8_MAX));
+    }
+
+    typedef void (*Encoder)(const VertexAttribute&, const float*, unsigned char*);
+
+    Encoder EncoderFor(VertexAttribute::Format format) {
+      switch (format) {
+      case VertexAttribute::FLOAT32: return EncodeFloat32;
+      case VertexAttribute::HALF16: return EncodeHalf16;
+      case VertexAttribute::UNORM16: return EncodeUnorm16;
+      case VertexAttribute::OCTAHEDRAL16: return EncodeOctahedral16;
+      case VertexAttribute::OCTAHEDRAL8: return EncodeOctahedral8;
+      case VertexAttribute::NOT_PRESENT: break;
+      }
+      return nullptr;
+    }
+
+    // One format's loop, with its encoder inlined
+    template <Encoder Encode>
+    void EncodeAll(const VertexAttribute& attribute, const float* in, std::size_t inStride,
+      std::size_t count, unsigned char* data
+    ) {
+      unsigned char* out = data + attribute.offset;
+      for (std::size_t v = 0; v < count; v++, in += inStride, out += attribute.stride) {
+        Encode(attribute, in, out);
+      }
+    }
+
+  }
+
+  unsigned int VertexAttribute::Size() const {
+    unsigned int size = 0;
+    switch (format) {
+    case FLOAT32: size = 4 * components; break;
+    case HALF16: size = 2 * components; break;
+    case UNORM16: size = 2 * components; break;
+    case OCTAHEDRAL16: size = 4; break;
+    case OCTAHEDRAL8: size = 2; break;
+    case NOT_PRESENT: break;
+    }
+    return size;
+  }
+
+  unsigned int VertexAttribute::Alignment() const {
+    return (format == FLOAT32) ? 4 : 2;
+  }
+
+  void VertexAttribute::Read(const unsigned char* data, std::size_t vertex, float* out) const {
+    const unsigned char* p = data + offset + vertex * stride;
+
+    switch (format) {
+    case FLOAT32:
+      memcpy(out, p, components * sizeof(float));
+      break;
+
+    case HALF16:
+      for (unsigned int c = 0; c < components; c++) {
+        out[c] = FromHalf(Load<std::uint16_t>(p + 2 * c));
+      }
+      break;
+
+    case UNORM16:
+      for (unsigned int c = 0; c < components; c++) {
+        out[c] = bias[c] + scale[c] * (Load<std::uint16_t>(p + 2 * c) / UNORM16_MAX);
+      }
+      break;
+
+    case OCTAHEDRAL16:
+      FromOctahedron(
+        Clamp(Load<std::int16_t>(p) / SNORM16_MAX, -1, 1),
+        Clamp(Load<std::int16_t>(p + 2) / SNORM16_MAX, -1, 1), out);
+      break;
+
+    case OCTAHEDRAL8:
+      FromOctahedron(
+        Clamp(Load<std::int8_t>(p) / SNORM8_MAX, -1, 1),
+        Clamp(Load<std::int8_t>(p + 1) / SNORM8_MAX, -1, 1), out);
+      break;
+
+    case NOT_PRESENT:
+      break;
+    }
+  }
+
+  void VertexAttribute::Write(const float* in, unsigned char* data, std::size_t vertex) const {
+    Encoder encode = EncoderFor(format);
+    if (encode) {
+      encode(*this, in, data + offset + vertex * stride);
+    }
+  }
+
+  void VertexAttribute::WriteAll(const float* in, std::size_t inStride, std::size_t count,
+    unsigned char* data
+  ) const {
+    switch (format) {
+    case FLOAT32: EncodeAll<EncodeFloat32>(*this, in, inStride, count, data); break;
+    case HALF16: EncodeAll<EncodeHalf16>(*this, in, inStride, count, data); break;
+    case UNORM16: EncodeAll<EncodeUnorm16>(*this, in, inStride, count, data); break;
+    case OCTAHEDRAL16: EncodeAll<EncodeOctahedral16>(*this, in, inStride, count, data); break;
+    case OCTAHEDRAL8: EncodeAll<EncodeOctahedral8>(*this, in, inStride, count, data); break;
+    case NOT_PRESENT: break;
+    }
+  }
+
+} // namespace james
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+
+namespace james {
+
+  // Where an attribute of a Mesh3d's vertices sits in its data, and how it's encoded
+  struct VertexAttribute {
+    enum Format {
+      NOT_PRESENT,
+      // One 32-bit float per component
+      FLOAT32,
+      // One IEEE half-precision float per component
+      HALF16,
+      // One 16-bit unsigned integer per component, n standing for bias + scale * n / 65535,
+      // where bias is the least of the attribute's values over the mesh and scale their range
+      UNORM16,
+      // A unit vector mapped onto an octahedron, unfolded into a square and stored as two
+      // signed 16-bit or 8-bit normalised integers
+      OCTAHEDRAL16,
+      OCTAHEDRAL8
+    };
+
+    Format format;
+    unsigned int offset;       // Of vertex 0's value, in bytes from the start of the data
+    unsigned int stride;       // Bytes from one vertex's value to the next's
+    unsigned int components;   // Once decoded: 3 for positions and normals, 2 for UVs
+    float bias[3];             // For UNORM16
+    float scale[3];
+
+    // Bytes one value takes, with no padding: 6 for three UNORM16s, 2 for OCTAHEDRAL8
+    unsigned int Size() const;
+
+    // The boundary a value starts on: 4 bytes for FLOAT32 and 2 for the other formats,
+    // whose values are made of 16-bit (or, for OCTAHEDRAL8, paired 8-bit) integers
+    unsigned int Alignment() const;
+
+    // Decodes the value of the vertex into components floats
+    void Read(const unsigned char* data, std::size_t vertex, float* out) const;
+
+    // Encodes components floats as the value of the vertex
+    void Write(const float* in, unsigned char* data, std::size_t vertex) const;
+
+    // Encodes the values of vertices 0 to count, reading each one's floats inStride
+    // floats after the last's. The format is only looked at once.
+    void WriteAll(const float* in, std::size_t inStride, std::size_t count, unsigned char* data) const;
+  };
+
+  // The formats to store a model's vertices in, and how to arrange them. Formats that
+  // can't hold an attribute (octahedral positions, say) are taken as FLOAT32.
+  struct VertexEncoding {
+    enum Layout {
+      // Each vertex's attributes together (an array of structures)
+      INTERLEAVED,
+      // An array for each attribute (a structure of arrays)
+      SEPARATE,
+      // Positions in an array of their own, for depth-only passes, and the other
+      // attributes interleaved in a second array
+      POSITION_STREAM
+    };
+
+    VertexAttribute::Format position;   // FLOAT32 or UNORM16
+    VertexAttribute::Format normal;     // FLOAT32, OCTAHEDRAL16 or OCTAHEDRAL8
+    VertexAttribute::Format texCoord;   // FLOAT32, HALF16 or UNORM16
+    Layout layout;
+
+    VertexEncoding()
+      : position(VertexAttribute::FLOAT32), normal(VertexAttribute::FLOAT32),
+        texCoord(VertexAttribute::FLOAT32), layout(INTERLEAVED) {}
+  };
+
+} // namespace james
\ No newline at end of file
@@ -1,15 +1,316 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <james/expat-parser.hpp>
 #include <james/load-collada.hpp>
+#include "james/collada/numeric-text.hpp"
+
+#ifdef _WIN32
+#  include <direct.h>
+#else
+#  include <sys/stat.h>
+#endif
 
 using namespace std;
 using namespace james;
 
+namespace {
+
+  int failures = 0;
+
+  void Check(bool ok, const char* what) {
+    cout << (ok ? "ok      " : "FAILED  ") << what << endl;
+    failures += ok ? 0 : 1;
+  }
+
+  // A stream that can't be read has to fail the load, not hang it
+  bool StreamThrows(const char* path) {
+    ifstream src(path);
+    try {
+      LoadCollada(src);
+    }
+    catch (const ParseError&) {
+      return true;
+    }
+    return false;
+  }
+
+  // Whichever parser reads it, a malformed document throws the same exception type
+  bool PathThrows(const char* path, LoadOptions::Parser parser) {
+    LoadOptions options;
+    options.parser = parser;
+    try {
+      LoadCollada(path, options);
+    }
+    catch (const ParseError&) {
+      return true;
+    }
+    return false;
+  }
+
+  // Decimals whose nearest double is exactly halfway between two floats, which
+  // rounding through double would get wrong
+  bool DecodesAsStrtof(const char* token) {
+    collada::FloatSource out;
+    collada::DecodeFloats(token, token + strlen(token), out);
+    float expected = strtof(token, nullptr);
+    return out.size() == 1 && memcmp(&out[0], &expected, sizeof(expected)) == 0;
+  }
+
+  // Whether every byte of the meshes' data that no attribute uses is zero
+  bool GapsAreZero(const Model3d& model) {
+    for (const Mesh3d& mesh : model.Meshes()) {
+      vector<bool> used(mesh.data.size(), false);
+      for (const VertexAttribute* attribute : { &mesh.position, &mesh.normal, &mesh.texCoord }) {
+        if (attribute->format == VertexAttribute::NOT_PRESENT) {
+          continue;
+        }
+        for (size_t v = 0; v < mesh.vertexCount; v++) {
+          size_t at = attribute->offset + v * attribute->stride;
+          for (size_t i = at; i < at + attribute->Size(); i++) {
+            used[i] = true;
+          }
+        }
+      }
+      for (size_t i = 0; i < mesh.data.size(); i++) {
+        if (!used[i] && mesh.data[i] != 0) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  bool SameData(const Model3d& a, const Model3d& b) {
+    if (a.Meshes().size() != b.Meshes().size()) {
+      return false;
+    }
+    for (size_t i = 0; i < a.Meshes().size(); i++) {
+      const Mesh3d& x = a.Meshes()[i];
+      const Mesh3d& y = b.Meshes()[i];
+      if (x.data.size() != y.data.size() || memcmp(x.data.data(), y.data.data(), x.data.size()) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // UNORM16 positions (6 bytes) with float normals leave a vertex short of a multiple of
+  // 4 bytes, so its stride is padded; the padding has to be zeros, not whatever was in
+  // memory
+  bool PaddingIsZero(const char* path) {
+    LoadOptions options;
+    options.encoding.position = VertexAttribute::UNORM16;
+
+    Model3d model(LoadCollada(path, options));
+    bool padded = false;
+    for (const Mesh3d& mesh : model.Meshes()) {
+      unsigned int size = mesh.position.Size() + mesh.normal.Size() + mesh.texCoord.Size();
+      padded = padded || mesh.position.stride > size;
+    }
+    return padded && GapsAreZero(model);
+  }
+
+  template <typename T>
+  bool SameBytes(const Span<const T>& a, const Span<const T>& b) {
+    return a.size() == b.size() && (a.size() == 0 || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+  }
+
+  // Whether the meshes' vertices, indices, meshlets and bounds are the same byte for byte
+  bool SameMeshes(const Model3d& a, const Model3d& b) {
+    if (a.Meshes().size() != b.Meshes().size()) {
+      return false;
+    }
+    for (size_t i = 0; i < a.Meshes().size(); i++) {
+      const Mesh3d& x = a.Meshes()[i];
+      const Mesh3d& y = b.Meshes()[i];
+      if (!SameBytes(x.data, y.data) || !SameBytes(x.indices, y.indices) || !SameBytes(x.meshlets, y.meshlets)
+        || memcmp(&x.bounds, &y.bounds, sizeof(Bounds)) != 0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const char CACHE_DIRECTORY[] = "test-cache";
+
+  // A model mapped from the cache is the one parsing gives, and the file holds nothing
+  // else. The first load with the cache parses and saves the model (unless an earlier
+  // run saved it), and the second maps it.
+  bool CachesAlike(const char* path, const VertexEncoding& encoding) {
+#ifdef _WIN32
+    _mkdir(CACHE_DIRECTORY);
+#else
+    mkdir(CACHE_DIRECTORY, 0777);
+#endif
+
+    LoadOptions options;
+    options.encoding = encoding;
+    options.buildMeshlets = true;
+    Model3d parsed(LoadCollada(path, options));
+
+    options.cacheDirectory = CACHE_DIRECTORY;
+    Model3d saved(LoadCollada(path, options));
+    Model3d mapped(LoadCollada(path, options));
+
+    return parsed.Meshes().size() > 0 && SameMeshes(parsed, saved) && SameMeshes(parsed, mapped)
+      && GapsAreZero(mapped);
+  }
+
+  // A concave pentagon, starting at a corner a fan from which would cross the notch at
+  // (1, 1): its triangles have to be ear clipped
+  const char CONCAVE_POLYGON[] =
+    "<COLLADA version=\"1.4.1\"><library_geometries><geometry id=\"g\"><mesh>"
+    "<source id=\"p\"><float_array id=\"a\" count=\"15\">0 2 0  0 0 0  3 0 0  3 2 0  1 1 0</float_array>"
+    "<technique_common><accessor source=\"#a\" count=\"5\" stride=\"3\">"
+    "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/>"
+    "</accessor></technique_common></source>"
+    "<vertices id=\"v\"><input semantic=\"POSITION\" source=\"#p\"/></vertices>"
+    "<polylist count=\"1\"><input semantic=\"VERTEX\" source=\"#v\" offset=\"0\"/>"
+    "<vcount>5</vcount><p>0 1 2 3 4</p></polylist>"
+    "</mesh></geometry></library_geometries></COLLADA>";
+
+  // Whether the model is the pentagon's three triangles, all counterclockwise and
+  // together covering its area of 4.5
+  bool CoversPentagon(const Model3d& model) {
+    if (model.Meshes().size() != 1) {
+      return false;
+    }
+
+    const Mesh3d& mesh = model.Meshes()[0];
+    if (mesh.indices.size() != 9) {
+      return false;
+    }
+
+    float area = 0;
+    for (size_t t = 0; t < 9; t += 3) {
+      float a[3], b[3], c[3];
+      mesh.position.Read(mesh.data.data(), mesh.indices[t], a);
+      mesh.position.Read(mesh.data.data(), mesh.indices[t + 1], b);
+      mesh.position.Read(mesh.data.data(), mesh.indices[t + 2], c);
+
+      float twice = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+      if (twice <= 0) {
+        return false;
+      }
+      area += twice / 2;
+    }
+    return area == 4.5f;
+  }
+
+  // With expat, with SimdXmlParser, and with its decoding deferred to several threads
+  bool TriangulatesConcavePolygon() {
+    istringstream src(CONCAVE_POLYGON);
+    LoadOptions expat;
+    expat.parser = LoadOptions::EXPAT_PARSER;
+
+    LoadOptions inlined;
+    inlined.parser = LoadOptions::SIMD_PARSER;
+    inlined.threads = 1;
+
+    LoadOptions deferred;
+    deferred.parser = LoadOptions::SIMD_PARSER;
+    deferred.threads = 4;
+
+    const size_t length = sizeof(CONCAVE_POLYGON) - 1;
+    return CoversPentagon(LoadCollada(src, expat))
+      && CoversPentagon(LoadCollada(CONCAVE_POLYGON, length, inlined))
+      && CoversPentagon(LoadCollada(CONCAVE_POLYGON, length, deferred));
+  }
+
+  // An empty <float_array> and then one with the same id: the second is the one the
+  // accessors read, however many threads decode the numbers
+  const char REDEFINED_ARRAY[] =
+    "<COLLADA version=\"1.4.1\"><library_geometries><geometry id=\"g\"><mesh>"
+    "<source id=\"e\"><float_array id=\"a\" count=\"0\"> </float_array></source>"
+    "<source id=\"p\"><float_array id=\"a\" count=\"9\">0 0 0  1 0 0  0 1 0</float_array>"
+    "<technique_common><accessor source=\"#a\" count=\"3\" stride=\"3\">"
+    "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/>"
+    "</accessor></technique_common></source>"
+    "<vertices id=\"v\"><input semantic=\"POSITION\" source=\"#p\"/></vertices>"
+    "<triangles count=\"1\"><input semantic=\"VERTEX\" source=\"#v\" offset=\"0\"/>"
+    "<p>0 1 2</p></triangles>"
+    "</mesh></geometry></library_geometries></COLLADA>";
+
+  bool SkipsEmptyArrays() {
+    LoadOptions inlined;
+    inlined.parser = LoadOptions::SIMD_PARSER;
+    inlined.threads = 1;
+
+    LoadOptions deferred;
+    deferred.parser = LoadOptions::SIMD_PARSER;
+    deferred.threads = 4;
+
+    const size_t length = sizeof(REDEFINED_ARRAY) - 1;
+    Model3d a(LoadCollada(REDEFINED_ARRAY, length, inlined));
+    Model3d b(LoadCollada(REDEFINED_ARRAY, length, deferred));
+    return a.Meshes().size() == 1 && a.Meshes()[0].indices.size() == 3 && SameMeshes(a, b);
+  }
+
+  // Two loads with the same options give the same data, gaps between the arrays included
+  bool LoadsAlike(const char* path, VertexEncoding::Layout layout) {
+    LoadOptions options;
+    options.encoding.position = VertexAttribute::UNORM16;
+    options.encoding.layout = layout;
+
+    Model3d first(LoadCollada(path, options));
+    Model3d second(LoadCollada(path, options));
+    return GapsAreZero(first) && GapsAreZero(second) && SameData(first, second);
+  }
+
+}
+
 int main() {
+  Check(StreamThrows("files/no-such-file.dae"), "a missing file throws");
+  Check(StreamThrows("files"), "a directory throws");
+
+  {
+    ofstream bad("malformed.dae");
+    bad << "<COLLADA version=\"1.4.1\"><library_geometries></COLLADA>";
+  }
+  Check(StreamThrows("malformed.dae"), "a malformed stream throws ParseError");
+  Check(PathThrows("malformed.dae", LoadOptions::AUTO_PARSER), "a malformed file throws ParseError");
+  Check(PathThrows("malformed.dae", LoadOptions::EXPAT_PARSER), "a malformed file throws ParseError with expat");
+  remove("malformed.dae");
+
+  Check(DecodesAsStrtof("7.719815492630005"), "7.719815492630005 decodes as strtof");
+  Check(DecodesAsStrtof("0.087012629956007"), "0.087012629956007 decodes as strtof");
+  Check(DecodesAsStrtof("0.646824985742569"), "0.646824985742569 decodes as strtof");
+
+  const char* layoutFiles[] = { "files/2-colour.dae", "files/tree.dae" };
+  for (const char* path : layoutFiles) {
+    Check(LoadsAlike(path, VertexEncoding::INTERLEAVED), "interleaved vertices load alike");
+    Check(LoadsAlike(path, VertexEncoding::SEPARATE), "separate vertices load alike");
+    Check(LoadsAlike(path, VertexEncoding::POSITION_STREAM), "position streams load alike");
+  }
+
+  Check(TriangulatesConcavePolygon(), "a concave polygon is ear clipped");
+  Check(SkipsEmptyArrays(), "an empty float_array is skipped, decoded deferred or not");
+
+  VertexEncoding quantised;
+  quantised.position = VertexAttribute::UNORM16;
+  quantised.normal = VertexAttribute::OCTAHEDRAL8;
+  quantised.texCoord = VertexAttribute::HALF16;
+  quantised.layout = VertexEncoding::SEPARATE;
+
+  for (const char* path : layoutFiles) {
+    Check(CachesAlike(path, VertexEncoding()), "a cached model is the parsed one");
+    Check(CachesAlike(path, quantised), "a cached quantised model is the parsed one");
+  }
+
+  Check(PaddingIsZero("files/tree.dae"), "padding in interleaved vertices is zero");
+
   ifstream src("files/cube.dae");
   src.exceptions(ios::badbit);
 
   Model3d m(LoadCollada(src));
+  Check(m.Meshes().size() > 0, "cube.dae loads");
 
   cin.get();
+  return failures;
 }